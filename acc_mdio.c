@@ -26,6 +26,7 @@
 #include <linux/mii.h>
 #include <linux/sockios.h>
 
+#include "fileaccess.h"
 #include "fileaccpriv.h"
 
 #define container_of(ptr, type, member) \
@@ -129,6 +130,82 @@ static int mdio_close(struct memtool_fd *handle)
 	return ret;
 }
 
+/*
+ * Probe all addresses on the MDIO bus of scan->ifname and read the first
+ * scan->nregs registers of each phy found. A phy is considered present if
+ * its identifier registers are neither all zeros nor all ones. Uses a single
+ * socket and ifreq for all accesses.
+ */
+int mdio_scan(struct mdio_scan *scan)
+{
+	struct ifreq ifr;
+	struct mii_ioctl_data *mii = (void *)&ifr.ifr_data;
+	unsigned int phy, reg;
+	int fd, ret, err = 0;
+
+	if (strlen(scan->ifname) >= sizeof(ifr.ifr_name)) {
+		fprintf(stderr, "device string too long\n");
+		return -EINVAL;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -errno;
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	strcpy(ifr.ifr_name, scan->ifname);
+
+	scan->present = 0;
+
+	for (phy = 0; phy < MDIO_NR_PHYS; phy++) {
+		uint16_t *regs = scan->regs[phy];
+
+		mii->phy_id = phy;
+
+		for (reg = 2; reg <= 3; reg++) {
+			mii->reg_num = reg;
+			ret = ioctl(fd, SIOCGMIIREG, &ifr);
+			if (ret < 0)
+				break;
+			regs[reg] = mii->val_out;
+		}
+
+		if (ret < 0) {
+			err = errno;
+			continue;
+		}
+
+		if ((regs[2] == 0xffff && regs[3] == 0xffff) ||
+		    (regs[2] == 0 && regs[3] == 0))
+			continue;
+
+		for (reg = 0; reg < scan->nregs; reg++) {
+			mii->reg_num = reg;
+			ret = ioctl(fd, SIOCGMIIREG, &ifr);
+			if (ret < 0) {
+				err = errno;
+				break;
+			}
+			regs[reg] = mii->val_out;
+		}
+
+		if (reg == scan->nregs)
+			scan->present |= 1U << phy;
+	}
+
+	close(fd);
+
+	/* don't report errors of single addresses if any phy answered */
+	if (!scan->present && err) {
+		errno = err;
+		return -err;
+	}
+
+	return 0;
+}
+
 struct memtool_fd *mdio_open(const char *spec, int flags)
 {
 	struct memtool_mdio_fd *mdio_fd;
@@ -145,6 +222,10 @@ struct memtool_fd *mdio_open(const char *spec, int flags)
 	mdio_fd->mfd.read = mdio_read;
 	mdio_fd->mfd.write = mdio_write;
 	mdio_fd->mfd.close = mdio_close;
+	mdio_fd->mfd.hole_size = NULL;
+	mdio_fd->mfd.data_size = NULL;
+	mdio_fd->mfd.map = NULL;
+	mdio_fd->mfd.unmap = NULL;
 
 	mdio_fd->fd = socket(AF_INET, SOCK_DGRAM, 0);
 	if (mdio_fd->fd < 0) {
@@ -24,6 +24,7 @@
 #include <unistd.h>
 
 #include "fileaccpriv.h"
+#include "memaccess.h"
 
 #define container_of(ptr, type, member) \
 	(type *)((char *)(ptr) - (char *) &((type *)0)->member)
@@ -46,8 +47,80 @@ struct memtool_mmap_fd {
 	struct memtool_fd mfd;
 	struct stat s;
 	int fd;
+	/* only used by handles created by mmap_open_window() */
+	void *map;
+	size_t map_len;
+	void *window;
+	size_t size;
 };
 
+/* make sure a regular file is big enough to write nbytes at offset */
+static int mmap_extend(struct memtool_mmap_fd *mmap_fd, off_t offset,
+		       size_t nbytes)
+{
+	struct stat *s = &mmap_fd->s;
+	int ret;
+
+	if (S_ISREG(s->st_mode) && s->st_size < offset + nbytes) {
+		ret = posix_fallocate(mmap_fd->fd, offset, nbytes);
+		if (ret) {
+			errno = ret;
+			perror("fallocate");
+			return -1;
+		}
+		s->st_size = offset + nbytes;
+	}
+
+	return 0;
+}
+
+static size_t mmap_hole_size(struct memtool_fd *handle, off_t offset,
+			     size_t nbytes)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+	struct stat *s = &mmap_fd->s;
+	off_t data;
+
+	if (!S_ISREG(s->st_mode) || s->st_size <= offset)
+		return 0;
+
+	data = lseek(mmap_fd->fd, offset, SEEK_DATA);
+	if (data < 0) {
+		/* ENXIO means there is only a hole up to the end of file */
+		if (errno != ENXIO)
+			return 0;
+		data = s->st_size;
+	}
+
+	if (data - offset < nbytes)
+		nbytes = data - offset;
+
+	return nbytes;
+}
+
+static size_t mmap_data_size(struct memtool_fd *handle, off_t offset,
+			     size_t nbytes)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+	struct stat *s = &mmap_fd->s;
+	off_t hole;
+
+	if (!S_ISREG(s->st_mode) || s->st_size <= offset)
+		return nbytes;
+
+	/* the end of file counts as a hole */
+	hole = lseek(mmap_fd->fd, offset, SEEK_HOLE);
+	if (hole < 0)
+		return nbytes;
+
+	if (hole - offset < nbytes)
+		nbytes = hole - offset;
+
+	return nbytes;
+}
+
 static ssize_t mmap_read(struct memtool_fd *handle, off_t offset,
 			 void *buf, size_t nbytes, int width)
 {
@@ -55,8 +128,8 @@ static ssize_t mmap_read(struct memtool_fd *handle, off_t offset,
 		container_of(handle, struct memtool_mmap_fd, mfd);
 	struct stat *s = &mmap_fd->s;
 	off_t map_start, map_off;
+	size_t copied;
 	void *map;
-	size_t i = 0;
 	int ret;
 
 	if (S_ISREG(s->st_mode)) {
@@ -69,6 +142,13 @@ static ssize_t mmap_read(struct memtool_fd *handle, off_t offset,
 		if (s->st_size < offset + nbytes)
 			/* truncating */
 			nbytes = s->st_size - offset;
+
+		/* don't fault in pages of a hole just to read zeros */
+		if (mmap_hole_size(handle, offset, nbytes) == nbytes) {
+			nbytes &= ~(width - 1);
+			memset(buf, 0, nbytes);
+			return nbytes;
+		}
 	}
 
 	map_start = offset & ~(mmap_pagesize() - 1);
@@ -81,23 +161,7 @@ static ssize_t mmap_read(struct memtool_fd *handle, off_t offset,
 		return -1;
 	}
 
-	while (i * width + width <= nbytes) {
-		switch (width) {
-		case 1:
-			((uint8_t *)buf)[i] = ((uint8_t *)(map + map_off))[i];
-			break;
-		case 2:
-			((uint16_t *)buf)[i] = ((uint16_t *)(map + map_off))[i];
-			break;
-		case 4:
-			((uint32_t *)buf)[i] = ((uint32_t *)(map + map_off))[i];
-			break;
-		case 8:
-			((uint64_t *)buf)[i] = ((uint64_t *)(map + map_off))[i];
-			break;
-		}
-		++i;
-	}
+	copied = mem_copy_from(buf, map + map_off, nbytes, width);
 
 	ret = munmap(map, nbytes + map_off);
 	if (ret < 0) {
@@ -105,7 +169,7 @@ static ssize_t mmap_read(struct memtool_fd *handle, off_t offset,
 		return -1;
 	}
 
-	return i * width;
+	return copied;
 }
 
 static ssize_t mmap_write(struct memtool_fd *handle, off_t offset,
@@ -113,21 +177,14 @@ static ssize_t mmap_write(struct memtool_fd *handle, off_t offset,
 {
 	struct memtool_mmap_fd *mmap_fd =
 		container_of(handle, struct memtool_mmap_fd, mfd);
-	struct stat *s = &mmap_fd->s;
 	off_t map_start, map_off;
+	size_t copied;
 	void *map;
-	size_t i = 0;
 	int ret;
 
-	if (S_ISREG(s->st_mode) && s->st_size < offset + nbytes) {
-		ret = posix_fallocate(mmap_fd->fd, offset, nbytes);
-		if (ret) {
-			errno = ret;
-			perror("fallocate");
-			return -1;
-		}
-		s->st_size = offset + nbytes;
-	}
+	ret = mmap_extend(mmap_fd, offset, nbytes);
+	if (ret < 0)
+		return -1;
 
 	map_start = offset & ~(mmap_pagesize() - 1);
 	map_off = offset - map_start;
@@ -139,23 +196,7 @@ static ssize_t mmap_write(struct memtool_fd *handle, off_t offset,
 		return -1;
 	}
 
-	while (i * width + width <= nbytes) {
-		switch (width) {
-		case 1:
-			((uint8_t *)(map + map_off))[i] = ((uint8_t *)buf)[i];
-			break;
-		case 2:
-			((uint16_t *)(map + map_off))[i] = ((uint16_t *)buf)[i];
-			break;
-		case 4:
-			((uint32_t *)(map + map_off))[i] = ((uint32_t *)buf)[i];
-			break;
-		case 8:
-			((uint64_t *)(map + map_off))[i] = ((uint64_t *)buf)[i];
-			break;
-		}
-		++i;
-	}
+	copied = mem_copy_to(map + map_off, buf, nbytes, width);
 
 	ret = munmap(map, nbytes + map_off);
 	if (ret < 0) {
@@ -163,7 +204,50 @@ static ssize_t mmap_write(struct memtool_fd *handle, off_t offset,
 		return -1;
 	}
 
-	return i * width;
+	return copied;
+}
+
+static void *mmap_map(struct memtool_fd *handle, off_t offset,
+		      size_t nbytes, int prot)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+	struct stat *s = &mmap_fd->s;
+	off_t map_start, map_off;
+	void *map;
+
+	if (prot & PROT_WRITE) {
+		if (mmap_extend(mmap_fd, offset, nbytes) < 0)
+			return NULL;
+	} else if (S_ISREG(s->st_mode) && s->st_size < offset + nbytes) {
+		errno = EINVAL;
+		perror("File to small");
+		return NULL;
+	}
+
+	map_start = offset & ~(mmap_pagesize() - 1);
+	map_off = offset - map_start;
+
+	map = mmap(NULL, nbytes + map_off, prot, MAP_SHARED,
+		   mmap_fd->fd, map_start);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+
+	return map + map_off;
+}
+
+static int mmap_unmap(struct memtool_fd *handle, void *addr, size_t nbytes)
+{
+	off_t map_off = (uintptr_t)addr & (mmap_pagesize() - 1);
+	int ret;
+
+	ret = munmap(addr - map_off, nbytes + map_off);
+	if (ret < 0)
+		perror("munmap");
+
+	return ret;
 }
 
 static int mmap_close(struct memtool_fd *handle)
@@ -190,9 +274,14 @@ struct memtool_fd *mmap_open(const char *spec, int flags)
 		return NULL;
 	}
 
+	mmap_fd->map = NULL;
 	mmap_fd->mfd.read = mmap_read;
 	mmap_fd->mfd.write = mmap_write;
 	mmap_fd->mfd.close = mmap_close;
+	mmap_fd->mfd.hole_size = mmap_hole_size;
+	mmap_fd->mfd.data_size = mmap_data_size;
+	mmap_fd->mfd.map = mmap_map;
+	mmap_fd->mfd.unmap = mmap_unmap;
 
 	mmap_fd->fd = open(spec, flags, S_IRUSR | S_IWUSR);
 	if (mmap_fd->fd < 0) {
@@ -211,3 +300,125 @@ struct memtool_fd *mmap_open(const char *spec, int flags)
 
 	return &mmap_fd->mfd;
 }
+
+static int window_check(struct memtool_mmap_fd *mmap_fd, off_t offset,
+			size_t nbytes)
+{
+	if (offset < 0 || offset > mmap_fd->size ||
+	    nbytes > mmap_fd->size - offset) {
+		errno = EINVAL;
+		perror("Access beyond end of window");
+		return -1;
+	}
+
+	return 0;
+}
+
+static ssize_t window_read(struct memtool_fd *handle, off_t offset,
+			   void *buf, size_t nbytes, int width)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+
+	if (window_check(mmap_fd, offset, nbytes))
+		return -1;
+
+	return mem_copy_from(buf, mmap_fd->window + offset, nbytes, width);
+}
+
+static ssize_t window_write(struct memtool_fd *handle, off_t offset,
+			    const void *buf, size_t nbytes, int width)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+
+	if (window_check(mmap_fd, offset, nbytes))
+		return -1;
+
+	return mem_copy_to(mmap_fd->window + offset, buf, nbytes, width);
+}
+
+static void *window_map(struct memtool_fd *handle, off_t offset,
+			size_t nbytes, int prot)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+
+	if (window_check(mmap_fd, offset, nbytes))
+		return NULL;
+
+	return mmap_fd->window + offset;
+}
+
+static int window_unmap(struct memtool_fd *handle, void *addr, size_t nbytes)
+{
+	/* the window stays mapped until the handle is closed */
+	return 0;
+}
+
+static int window_close(struct memtool_fd *handle)
+{
+	struct memtool_mmap_fd *mmap_fd =
+		container_of(handle, struct memtool_mmap_fd, mfd);
+
+	munmap(mmap_fd->map, mmap_fd->map_len);
+
+	return mmap_close(handle);
+}
+
+/*
+ * Open size bytes of spec starting at base as a window that is mapped once
+ * for the lifetime of the handle. Offsets of accesses are relative to base
+ * and must not exceed size. This is used for uio maps and PCI BARs.
+ */
+struct memtool_fd *mmap_open_window(const char *spec, int flags,
+				    off_t base, size_t size)
+{
+	struct memtool_mmap_fd *mmap_fd;
+	struct memtool_fd *mfd;
+	off_t map_start, map_off;
+	int prot = PROT_READ;
+
+	mfd = mmap_open(spec, flags & ~O_CREAT);
+	if (!mfd)
+		return NULL;
+
+	mmap_fd = container_of(mfd, struct memtool_mmap_fd, mfd);
+
+	if (S_ISREG(mmap_fd->s.st_mode) && mmap_fd->s.st_size < base + size) {
+		errno = EINVAL;
+		perror("File to small");
+		goto err;
+	}
+
+	if ((flags & O_ACCMODE) != O_RDONLY)
+		prot |= PROT_WRITE;
+
+	map_start = base & ~(mmap_pagesize() - 1);
+	map_off = base - map_start;
+
+	mmap_fd->map_len = size + map_off;
+	mmap_fd->map = mmap(NULL, mmap_fd->map_len, prot, MAP_SHARED,
+			    mmap_fd->fd, map_start);
+	if (mmap_fd->map == MAP_FAILED) {
+		perror("mmap");
+		goto err;
+	}
+
+	mmap_fd->window = mmap_fd->map + map_off;
+	mmap_fd->size = size;
+
+	mfd->read = window_read;
+	mfd->write = window_write;
+	mfd->close = window_close;
+	mfd->hole_size = NULL;
+	mfd->data_size = NULL;
+	mfd->map = window_map;
+	mfd->unmap = window_unmap;
+
+	return mfd;
+
+err:
+	mmap_close(mfd);
+	return NULL;
+}
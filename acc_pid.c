@@ -0,0 +1,306 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Access method for the memory of a running process. Offsets are virtual
+ * addresses in that process. They are accessed with process_vm_readv()
+ * and process_vm_writev() using one remote iovec per page, so a single
+ * system call transfers up to IOV_MAX pages and the first page that is
+ * not mapped can be reported.
+ *
+ * With pid:PID/phys the addresses are translated using /proc/PID/pagemap
+ * and the physical memory behind them is accessed through /dev/mem, e.g.
+ * to see what a device sees of a DMA buffer. This needs CAP_SYS_ADMIN.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "fileaccpriv.h"
+
+#define container_of(ptr, type, member) \
+	(type *)((char *)(ptr) - (char *) &((type *)0)->member)
+
+#define PAGEMAP_PRESENT		(1ULL << 63)
+#define PAGEMAP_PFN_MASK	((1ULL << 55) - 1)
+/* number of pagemap entries read at once */
+#define PAGEMAP_BATCH		512
+
+struct memtool_pid_fd {
+	struct memtool_fd mfd;
+	pid_t pid;
+	size_t pagesize;
+	/* only used with /phys */
+	int pagemap;
+	struct memtool_fd *mem;
+};
+
+static ssize_t pid_transfer(struct memtool_pid_fd *pid_fd, off_t offset,
+			    void *buf, size_t nbytes, int write)
+{
+	struct iovec local, remote[IOV_MAX];
+	size_t done = 0, len, n;
+	uintptr_t addr;
+	ssize_t ret;
+	int i;
+
+	while (done < nbytes) {
+		addr = offset + done;
+
+		for (i = 0, len = 0; i < IOV_MAX && done + len < nbytes; i++) {
+			n = pid_fd->pagesize - (addr + len) % pid_fd->pagesize;
+			if (n > nbytes - done - len)
+				n = nbytes - done - len;
+			remote[i].iov_base = (void *)(addr + len);
+			remote[i].iov_len = n;
+			len += n;
+		}
+
+		local.iov_base = buf + done;
+		local.iov_len = len;
+
+		if (write)
+			ret = process_vm_writev(pid_fd->pid, &local, 1,
+						remote, i, 0);
+		else
+			ret = process_vm_readv(pid_fd->pid, &local, 1,
+					       remote, i, 0);
+
+		/* a partial transfer stops at the first inaccessible page */
+		if (ret >= 0 && ret < len) {
+			done += ret;
+			ret = -1;
+			errno = EFAULT;
+		}
+
+		if (ret < 0) {
+			fprintf(stderr, "pid %d: cannot %s 0x%llx: %s\n",
+				(int)pid_fd->pid, write ? "write" : "read",
+				(unsigned long long)(offset + done),
+				strerror(errno));
+			return -1;
+		}
+
+		done += ret;
+	}
+
+	return nbytes;
+}
+
+/*
+ * Access the physical memory behind the virtual addresses. The pagemap
+ * entries are read in batches and physically contiguous pages are
+ * accessed together.
+ */
+static ssize_t pid_phys_transfer(struct memtool_pid_fd *pid_fd, off_t offset,
+				 void *buf, size_t nbytes, int width, int write)
+{
+	uint64_t entries[PAGEMAP_BATCH];
+	size_t pagesize = pid_fd->pagesize;
+	size_t done = 0, len, n;
+	uint64_t vpage, phys, next;
+	int i, nentries;
+	ssize_t ret;
+
+	while (done < nbytes) {
+		vpage = (offset + done) / pagesize;
+		n = ((offset + nbytes - 1) / pagesize) - vpage + 1;
+		if (n > PAGEMAP_BATCH)
+			n = PAGEMAP_BATCH;
+
+		ret = pread(pid_fd->pagemap, entries, n * sizeof(*entries),
+			    vpage * sizeof(*entries));
+		if (ret < 0) {
+			perror("pagemap");
+			return -1;
+		}
+		nentries = ret / sizeof(*entries);
+
+		for (i = 0; i < nentries && done < nbytes; ) {
+			if (!(entries[i] & PAGEMAP_PRESENT)) {
+				fprintf(stderr, "pid %d: 0x%llx is not present in memory\n",
+					(int)pid_fd->pid,
+					(unsigned long long)(offset + done));
+				return -1;
+			}
+
+			if (!(entries[i] & PAGEMAP_PFN_MASK)) {
+				fprintf(stderr, "pid %d: physical addresses need CAP_SYS_ADMIN\n",
+					(int)pid_fd->pid);
+				return -1;
+			}
+
+			phys = (entries[i] & PAGEMAP_PFN_MASK) * pagesize +
+				(offset + done) % pagesize;
+			len = pagesize - (offset + done) % pagesize;
+
+			/* add the following pages while they are contiguous */
+			for (next = entries[i] & PAGEMAP_PFN_MASK, i++;
+			     i < nentries && done + len < nbytes &&
+			     (entries[i] & PAGEMAP_PRESENT) &&
+			     (entries[i] & PAGEMAP_PFN_MASK) == next + 1;
+			     next++, i++)
+				len += pagesize;
+
+			if (len > nbytes - done)
+				len = nbytes - done;
+
+			/*
+			 * A value must not be split between two pages that are
+			 * not physically contiguous. At the end of a batch the
+			 * next page is not known yet, so leave the last value
+			 * for the next batch.
+			 */
+			if (len % width) {
+				if (i < nentries) {
+					fprintf(stderr, "pid %d: 0x%llx: value crosses into a physically non-contiguous page\n",
+						(int)pid_fd->pid,
+						(unsigned long long)(offset + done + len - len % width));
+					return -1;
+				}
+				len -= len % width;
+				if (!len)
+					break;
+			}
+
+			if (write)
+				ret = pid_fd->mem->write(pid_fd->mem, phys,
+							 buf + done, len, width);
+			else
+				ret = pid_fd->mem->read(pid_fd->mem, phys,
+							buf + done, len, width);
+			if (ret < 0)
+				return ret;
+			if (ret != len) {
+				fprintf(stderr, "pid %d: short %s at 0x%llx\n",
+					(int)pid_fd->pid, write ? "write" : "read",
+					(unsigned long long)(offset + done + ret));
+				return -1;
+			}
+
+			done += len;
+		}
+
+		if (!nentries) {
+			fprintf(stderr, "pid %d: 0x%llx is not a valid address\n",
+				(int)pid_fd->pid,
+				(unsigned long long)(offset + done));
+			return -1;
+		}
+	}
+
+	return nbytes;
+}
+
+static ssize_t pid_read(struct memtool_fd *handle, off_t offset,
+			void *buf, size_t nbytes, int width)
+{
+	struct memtool_pid_fd *pid_fd =
+		container_of(handle, struct memtool_pid_fd, mfd);
+
+	if (pid_fd->mem)
+		return pid_phys_transfer(pid_fd, offset, buf, nbytes, width, 0);
+
+	return pid_transfer(pid_fd, offset, buf, nbytes, 0);
+}
+
+static ssize_t pid_write(struct memtool_fd *handle, off_t offset,
+			 const void *buf, size_t nbytes, int width)
+{
+	struct memtool_pid_fd *pid_fd =
+		container_of(handle, struct memtool_pid_fd, mfd);
+
+	if (pid_fd->mem)
+		return pid_phys_transfer(pid_fd, offset, (void *)buf, nbytes,
+					 width, 1);
+
+	return pid_transfer(pid_fd, offset, (void *)buf, nbytes, 1);
+}
+
+static int pid_close(struct memtool_fd *handle)
+{
+	struct memtool_pid_fd *pid_fd =
+		container_of(handle, struct memtool_pid_fd, mfd);
+	int ret = 0;
+
+	if (pid_fd->mem) {
+		ret = pid_fd->mem->close(pid_fd->mem);
+		close(pid_fd->pagemap);
+	}
+
+	free(pid_fd);
+
+	return ret;
+}
+
+/* spec is PID[/phys] */
+struct memtool_fd *pid_open(const char *spec, int flags)
+{
+	struct memtool_pid_fd *pid_fd;
+	char path[PATH_MAX];
+	unsigned long pid;
+	char *endp;
+	int phys = 0;
+
+	pid = strtoul(spec, &endp, 10);
+	if (endp == spec || !pid)
+		goto err_parse;
+
+	if (!strcmp(endp, "/phys"))
+		phys = 1;
+	else if (*endp != '\0')
+		goto err_parse;
+
+	pid_fd = calloc(1, sizeof(*pid_fd));
+	if (!pid_fd) {
+		fprintf(stderr, "Failure to allocate pid_fd\n");
+		return NULL;
+	}
+
+	pid_fd->pid = pid;
+	pid_fd->pagesize = sysconf(_SC_PAGE_SIZE);
+	pid_fd->pagemap = -1;
+
+	if (phys) {
+		snprintf(path, sizeof(path), "/proc/%lu/pagemap", pid);
+		pid_fd->pagemap = open(path, O_RDONLY);
+		if (pid_fd->pagemap < 0) {
+			perror(path);
+			free(pid_fd);
+			return NULL;
+		}
+
+		pid_fd->mem = mmap_open("/dev/mem", flags);
+		if (!pid_fd->mem) {
+			close(pid_fd->pagemap);
+			free(pid_fd);
+			return NULL;
+		}
+	}
+
+	pid_fd->mfd.read = pid_read;
+	pid_fd->mfd.write = pid_write;
+	pid_fd->mfd.close = pid_close;
+
+	return &pid_fd->mfd;
+
+err_parse:
+	fprintf(stderr, "Failed to parse pid specifier, expected PID[/phys]\n");
+	return NULL;
+}
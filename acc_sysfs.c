@@ -0,0 +1,149 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Access methods for uio maps and PCI BARs. Both resolve the spec to a
+ * file and a window in it using sysfs and then use the mmap access method
+ * with a mapping that persists for the lifetime of the handle.
+ *
+ * The locations of sysfs and /dev can be changed by setting
+ * MEMTOOL_SYSFS_ROOT and MEMTOOL_DEV_ROOT in the environment.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "fileaccpriv.h"
+
+static const char *sysfs_root(void)
+{
+	const char *root = getenv("MEMTOOL_SYSFS_ROOT");
+
+	return root ? root : "/sys";
+}
+
+static const char *dev_root(void)
+{
+	const char *root = getenv("MEMTOOL_DEV_ROOT");
+
+	return root ? root : "/dev";
+}
+
+static int sysfs_read_ull(const char *path, unsigned long long *val)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	ret = fscanf(f, "%llx", val) == 1 ? 0 : -1;
+	if (ret)
+		errno = EINVAL;
+
+	fclose(f);
+
+	return ret;
+}
+
+/* spec is N[/mapM] */
+struct memtool_fd *uio_open(const char *spec, int flags)
+{
+	unsigned long long size, offs;
+	unsigned long dev, map = 0;
+	char path[PATH_MAX];
+	char *endp;
+
+	dev = strtoul(spec, &endp, 10);
+	if (endp == spec)
+		goto err_parse;
+
+	if (!strncmp(endp, "/map", 4)) {
+		spec = endp + 4;
+		map = strtoul(spec, &endp, 10);
+		if (endp == spec)
+			goto err_parse;
+	}
+
+	if (*endp != '\0')
+		goto err_parse;
+
+	snprintf(path, sizeof(path), "%s/class/uio/uio%lu/maps/map%lu/size",
+		 sysfs_root(), dev, map);
+	if (sysfs_read_ull(path, &size)) {
+		perror(path);
+		return NULL;
+	}
+
+	/* older kernels don't provide the offset of the map in its page */
+	snprintf(path, sizeof(path), "%s/class/uio/uio%lu/maps/map%lu/offset",
+		 sysfs_root(), dev, map);
+	if (sysfs_read_ull(path, &offs))
+		offs = 0;
+
+	snprintf(path, sizeof(path), "%s/uio%lu", dev_root(), dev);
+
+	return mmap_open_window(path, flags,
+				map * sysconf(_SC_PAGE_SIZE) + offs, size);
+
+err_parse:
+	fprintf(stderr, "Failed to parse uio specifier, expected N[/mapM]\n");
+	return NULL;
+}
+
+/* spec is [DOMAIN:]BUS:DEV.FN/barN */
+struct memtool_fd *pci_open(const char *spec, int flags)
+{
+	const char *delim, *domain = "";
+	char path[PATH_MAX];
+	struct stat s;
+	unsigned long bar;
+	char *endp;
+
+	delim = strchr(spec, '/');
+	if (!delim || strncmp(delim, "/bar", 4))
+		goto err_parse;
+
+	bar = strtoul(delim + 4, &endp, 10);
+	if (endp == delim + 4 || *endp != '\0' || bar > 5)
+		goto err_parse;
+
+	if (memchr(spec, ':', delim - spec) ==
+	    memrchr(spec, ':', delim - spec))
+		domain = "0000:";
+
+	snprintf(path, sizeof(path), "%s/bus/pci/devices/%s%.*s/resource%lu",
+		 sysfs_root(), domain, (int)(delim - spec), spec, bar);
+
+	if (stat(path, &s)) {
+		perror(path);
+		return NULL;
+	}
+
+	if (!s.st_size) {
+		fprintf(stderr, "%s: BAR cannot be mapped\n", path);
+		return NULL;
+	}
+
+	return mmap_open_window(path, flags, 0, s.st_size);
+
+err_parse:
+	fprintf(stderr,
+		"Failed to parse pci specifier, expected [DOMAIN:]BUS:DEV.FN/barN\n");
+	return NULL;
+}
@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# version 2, as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# Measure the exec-to-exit time of single value md and mw calls, which is
+# what scripts poking at registers pay per access. The accesses go to a file
+# on a tmpfs, so the numbers are the cost of memtool itself. Give two
+# binaries (both must be named memtool) to compare them, e.g. before and
+# after a change:
+#
+#	./bench-startup.sh -n 2000 -r 10 /tmp/old/memtool ./memtool
+#
+# The binaries take turns for ROUNDS rounds of RUNS runs each and the best
+# round is reported, which hides most of the noise of other processes.
+
+runs=1000
+rounds=5
+dir=/dev/shm
+
+usage() {
+	echo "Usage: $0 [-n <RUNS>] [-r <ROUNDS>] [-d <DIR>] MEMTOOL [MEMTOOL...]" >&2
+	exit 1
+}
+
+while getopts "n:r:d:" opt; do
+	case $opt in
+	n) runs=$OPTARG ;;
+	r) rounds=$OPTARG ;;
+	d) dir=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+[ $# -ge 1 ] || usage
+
+file=$(mktemp "$dir/memtool-bench.XXXXXX") || exit 1
+trap 'rm -f "$file"' EXIT
+head -c 4096 /dev/zero > "$file"
+
+# average time of one run of "$@" in nanoseconds
+bench() {
+	local i start end
+
+	start=$(date +%s%N)
+	for ((i = 0; i < runs; i++)); do
+		"$@" > /dev/null
+	done
+	end=$(date +%s%N)
+
+	echo $(( (end - start) / runs ))
+}
+
+declare -A best
+
+for memtool in "$@"; do
+	if ! "$memtool" md -l -s "$file" 0x10+4 > /dev/null ||
+	   ! "$memtool" mw -l -d "$file" 0x10 0x12345678; then
+		echo "$memtool does not work" >&2
+		exit 1
+	fi
+done
+
+for ((round = 0; round < rounds; round++)); do
+	for memtool in "$@"; do
+		t=$(bench "$memtool" md -l -s "$file" 0x10+4)
+		[ -z "${best[md $memtool]}" ] || [ "$t" -lt "${best[md $memtool]}" ] &&
+			best[md $memtool]=$t
+		t=$(bench "$memtool" mw -l -d "$file" 0x10 0x12345678)
+		[ -z "${best[mw $memtool]}" ] || [ "$t" -lt "${best[mw $memtool]}" ] &&
+			best[mw $memtool]=$t
+	done
+done
+
+printf "%-40s %10s %10s\n" "binary" "md us" "mw us"
+for memtool in "$@"; do
+	printf "%-40s %8d.%d %8d.%d\n" "$memtool" \
+		$((best[md $memtool] / 1000)) $((best[md $memtool] / 100 % 10)) \
+		$((best[mw $memtool] / 1000)) $((best[mw $memtool] / 100 % 10))
+done
@@ -11,16 +11,26 @@
  * GNU General Public License for more details.
  */
 
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "fileaccess.h"
 #include "fileaccpriv.h"
+#include "memaccess.h"
 
 void *memtool_open(const char *spec, int flags)
 {
 	if (!strncmp(spec, "mmap:", 5)) {
 		return mmap_open(spec + 5, flags);
+	} else if (!strncmp(spec, "uio:", 4)) {
+		return uio_open(spec + 4, flags);
+	} else if (!strncmp(spec, "pci:", 4)) {
+		return pci_open(spec + 4, flags);
+	} else if (!strncmp(spec, "pid:", 4)) {
+		return pid_open(spec + 4, flags);
 	} else if (!strncmp(spec, "mdio:", 5)) {
 #ifdef USE_MDIO
 		return mdio_open(spec + 5, flags);
@@ -33,20 +43,157 @@ void *memtool_open(const char *spec, int flags)
 	}
 }
 
+static FILE *recfile;
+
+static void memtool_record(int op, off_t offset, const void *buf,
+			   ssize_t nbytes, int width)
+{
+	struct memtool_rec rec = {
+		.width = width,
+		.op = op,
+	};
+	struct timespec ts;
+	ssize_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec.time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	for (i = 0; i + width <= nbytes; i += width) {
+		rec.value = mem_read(buf + i, width);
+		rec.offset = offset + i;
+
+		fwrite(&rec, sizeof(rec), 1, recfile);
+	}
+}
+
+/*
+ * Append all successful reads and writes to logfile until
+ * memtool_record_stop() is called. As timestamps use the monotonic clock,
+ * accesses of several memtool invocations can be collected in one log.
+ */
+int memtool_record_start(const char *logfile)
+{
+	struct memtool_rec_header hdr = {
+		.magic = MEMTOOL_REC_MAGIC,
+		.version = MEMTOOL_REC_VERSION,
+	};
+	struct stat s;
+
+	recfile = fopen(logfile, "a");
+	if (!recfile) {
+		perror("fopen");
+		return -1;
+	}
+
+	if (fstat(fileno(recfile), &s)) {
+		perror("fstat");
+		fclose(recfile);
+		recfile = NULL;
+		return -1;
+	}
+
+	if (s.st_size == 0)
+		fwrite(&hdr, sizeof(hdr), 1, recfile);
+
+	return 0;
+}
+
+int memtool_record_stop(void)
+{
+	int ret;
+
+	if (!recfile)
+		return 0;
+
+	ret = fclose(recfile);
+	if (ret)
+		perror("fclose");
+
+	recfile = NULL;
+
+	return ret;
+}
+
 ssize_t memtool_read(void *handle,
 		     off_t offset, void *buf, size_t nbytes, int width)
 {
 	struct memtool_fd *mfd = handle;
+	ssize_t ret;
+
+	ret = mfd->read(mfd, offset, buf, nbytes, width);
+	if (recfile && ret > 0)
+		memtool_record(MEMTOOL_REC_READ, offset, buf, ret, width);
 
-	return mfd->read(mfd, offset, buf, nbytes, width);
+	return ret;
 }
 
 ssize_t memtool_write(void *handle,
 		      off_t offset, const void *buf, size_t nbytes, int width)
+{
+	struct memtool_fd *mfd = handle;
+	ssize_t ret;
+
+	ret = mfd->write(mfd, offset, buf, nbytes, width);
+	if (recfile && ret > 0)
+		memtool_record(MEMTOOL_REC_WRITE, offset, buf, ret, width);
+
+	return ret;
+}
+
+/*
+ * Returns the number of bytes (at most nbytes) starting at offset that are
+ * known to read as zero without being backed by storage, i.e. a hole in a
+ * sparse file. 0 means there is data at offset or the access method cannot
+ * tell.
+ */
+size_t memtool_hole_size(void *handle, off_t offset, size_t nbytes)
+{
+	struct memtool_fd *mfd = handle;
+
+	if (!mfd->hole_size)
+		return 0;
+
+	return mfd->hole_size(mfd, offset, nbytes);
+}
+
+/*
+ * Returns the number of bytes (at most nbytes) starting at offset up to the
+ * next hole, see memtool_hole_size(). If the access method cannot tell,
+ * nbytes is returned.
+ */
+size_t memtool_data_size(void *handle, off_t offset, size_t nbytes)
+{
+	struct memtool_fd *mfd = handle;
+
+	if (!mfd->data_size)
+		return nbytes;
+
+	return mfd->data_size(mfd, offset, nbytes);
+}
+
+/*
+ * Map nbytes starting at offset into the address space to allow direct
+ * access, prot is as for mmap(2). Returns NULL with errno set to
+ * EOPNOTSUPP without printing an error if the access method doesn't
+ * support that. Note that accesses to the mapping are not recorded.
+ */
+void *memtool_map(void *handle, off_t offset, size_t nbytes, int prot)
+{
+	struct memtool_fd *mfd = handle;
+
+	if (!mfd->map) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	return mfd->map(mfd, offset, nbytes, prot);
+}
+
+int memtool_unmap(void *handle, void *addr, size_t nbytes)
 {
 	struct memtool_fd *mfd = handle;
 
-	return mfd->write(mfd, offset, buf, nbytes, width);
+	return mfd->unmap(mfd, addr, nbytes);
 }
 
 int memtool_close(void *handle)
@@ -11,11 +11,57 @@
  * GNU General Public License for more details.
  */
 
+#include <stdint.h>
 #include <sys/types.h>
 
+/*
+ * Layout of an access log as written by memtool_record_start(): a
+ * struct memtool_rec_header followed by any number of struct memtool_rec.
+ * All values are in host byte order.
+ */
+#define MEMTOOL_REC_MAGIC	0x4c52544dU	/* "MTRL" */
+#define MEMTOOL_REC_VERSION	1
+
+#define MEMTOOL_REC_READ	1
+#define MEMTOOL_REC_WRITE	2
+
+struct memtool_rec_header {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct memtool_rec {
+	uint64_t time;		/* CLOCK_MONOTONIC in ns */
+	uint64_t offset;
+	uint64_t value;
+	uint8_t width;
+	uint8_t op;
+	uint8_t reserved[6];
+};
+
 void *memtool_open(const char *spec, int flags);
 ssize_t memtool_read(void *handle, off_t offset,
 		     void *buf, size_t nbytes, int width);
 ssize_t memtool_write(void *handle, off_t offset,
 		      const void *buf, size_t nbytes, int width);
 int memtool_close(void *handle);
+size_t memtool_hole_size(void *handle, off_t offset, size_t nbytes);
+size_t memtool_data_size(void *handle, off_t offset, size_t nbytes);
+void *memtool_map(void *handle, off_t offset, size_t nbytes, int prot);
+int memtool_unmap(void *handle, void *addr, size_t nbytes);
+
+#define MDIO_NR_PHYS	32
+#define MDIO_NR_REGS	32
+
+/* result of mdio_scan() for a single network interface */
+struct mdio_scan {
+	const char *ifname;
+	unsigned int nregs;	/* number of registers to read per phy */
+	uint32_t present;	/* bit n set if a phy answers at address n */
+	uint16_t regs[MDIO_NR_PHYS][MDIO_NR_REGS];
+};
+
+int mdio_scan(struct mdio_scan *scan);
+
+int memtool_record_start(const char *logfile);
+int memtool_record_stop(void);
@@ -18,7 +18,22 @@ struct memtool_fd {
 	ssize_t (*write)(struct memtool_fd *handle, off_t offset,
 			 const void *buf, size_t nbytes, int width);
 	int (*close)(struct memtool_fd *handle);
+	/* optional, see memtool_hole_size() */
+	size_t (*hole_size)(struct memtool_fd *handle, off_t offset,
+			    size_t nbytes);
+	/* optional, see memtool_data_size() */
+	size_t (*data_size)(struct memtool_fd *handle, off_t offset,
+			    size_t nbytes);
+	/* optional, see memtool_map() */
+	void *(*map)(struct memtool_fd *handle, off_t offset,
+		     size_t nbytes, int prot);
+	int (*unmap)(struct memtool_fd *handle, void *addr, size_t nbytes);
 };
 
 struct memtool_fd *mdio_open(const char *spec, int flags);
 struct memtool_fd *mmap_open(const char *spec, int flags);
+struct memtool_fd *mmap_open_window(const char *spec, int flags,
+				    off_t base, size_t size);
+struct memtool_fd *uio_open(const char *spec, int flags);
+struct memtool_fd *pci_open(const char *spec, int flags);
+struct memtool_fd *pid_open(const char *spec, int flags);
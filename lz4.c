@@ -0,0 +1,222 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * A simple compressor and decompressor for the LZ4 block format. The
+ * compressor is the greedy single hash table variant, which is fast and
+ * good enough for memory dumps.
+ *
+ * A block is a sequence of (token, literals, offset, match length)
+ * records. The last record only contains literals.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4.h"
+
+#define MINMATCH	4
+#define LASTLITERALS	5	/* the last 5 bytes are always literals */
+#define MFLIMIT		12	/* the last match must start before this */
+#define MAX_DISTANCE	65535
+#define HASH_BITS	14
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t val;
+
+	memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+static inline uint32_t hash32(uint32_t val)
+{
+	return (val * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/* write the part of a length that doesn't fit into the token */
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+static uint8_t *put_literals(uint8_t *op, const uint8_t *lit, size_t len)
+{
+	uint8_t *token = op++;
+
+	if (len >= 15) {
+		*token = 15 << 4;
+		op = put_length(op, len - 15);
+	} else {
+		*token = len << 4;
+	}
+
+	memcpy(op, lit, len);
+
+	return op + len;
+}
+
+/*
+ * Compress srclen bytes from src to dst. Returns the size of the
+ * compressed data or 0 if it doesn't fit into dstlen bytes. Using
+ * LZ4_BOUND(srclen) for dstlen always succeeds.
+ */
+size_t lz4_compress(const void *src, size_t srclen, void *dst, size_t dstlen)
+{
+	uint32_t table[1 << HASH_BITS];
+	const uint8_t *base = src, *ip = src, *anchor = src;
+	const uint8_t *iend = base + srclen;
+	const uint8_t *ref, *mstart;
+	uint8_t *op = dst, *oend = op + dstlen;
+	unsigned int misses = 0;
+	size_t litlen, matchlen;
+	uint32_t seq, h;
+	uint8_t *token;
+
+	memset(table, 0, sizeof(table));
+
+	if (srclen < MFLIMIT + 1)
+		goto last_literals;
+
+	while (ip < iend - MFLIMIT) {
+		seq = read32(ip);
+		h = hash32(seq);
+		ref = base + table[h];
+		table[h] = ip - base;
+
+		if (ref >= ip || ip - ref > MAX_DISTANCE || read32(ref) != seq) {
+			/* skip faster through incompressible data */
+			ip += 1 + (misses++ >> 6);
+			continue;
+		}
+
+		misses = 0;
+		mstart = ip;
+		ip += MINMATCH;
+		ref += MINMATCH;
+		while (ip < iend - LASTLITERALS && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		litlen = mstart - anchor;
+		matchlen = ip - mstart - MINMATCH;
+
+		if (oend - op < 1 + litlen + litlen / 255 + 1 + 2 +
+				matchlen / 255 + 1)
+			return 0;
+
+		token = op;
+		op = put_literals(op, anchor, litlen);
+
+		*op++ = (ip - ref) & 0xff;
+		*op++ = (ip - ref) >> 8;
+
+		if (matchlen >= 15) {
+			*token |= 15;
+			op = put_length(op, matchlen - 15);
+		} else {
+			*token |= matchlen;
+		}
+
+		anchor = ip;
+	}
+
+last_literals:
+	litlen = iend - anchor;
+	if (oend - op < 1 + litlen + litlen / 255 + 1)
+		return 0;
+
+	op = put_literals(op, anchor, litlen);
+
+	return op - (uint8_t *)dst;
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+
+	do {
+		if (*ip >= iend)
+			return -1;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+/*
+ * Decompress srclen bytes from src to dst. Returns the size of the
+ * decompressed data or -1 if src is corrupt or doesn't fit into dstlen
+ * bytes.
+ */
+ssize_t lz4_decompress(const void *src, size_t srclen,
+		       void *dst, size_t dstlen)
+{
+	const uint8_t *ip = src, *iend = ip + srclen;
+	uint8_t *op = dst, *oend = op + dstlen;
+	const uint8_t *match;
+	size_t len, offset;
+	uint8_t token;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		len = token >> 4;
+		if (len == 15 && get_length(&ip, iend, &len))
+			return -1;
+
+		if (len > iend - ip || len > oend - op)
+			return -1;
+
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -1;
+
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (!offset || offset > op - (uint8_t *)dst)
+			return -1;
+
+		len = token & 15;
+		if (len == 15 && get_length(&ip, iend, &len))
+			return -1;
+		len += MINMATCH;
+
+		if (len > oend - op)
+			return -1;
+
+		match = op - offset;
+		if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			/* overlapping copy repeats the last offset bytes */
+			while (len--)
+				*op++ = *match++;
+		}
+	}
+
+	return op - (uint8_t *)dst;
+}
@@ -0,0 +1,19 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+
+/* worst case size of compressing len bytes */
+#define LZ4_BOUND(len)	((len) + (len) / 255 + 16)
+
+size_t lz4_compress(const void *src, size_t srclen, void *dst, size_t dstlen);
+ssize_t lz4_decompress(const void *src, size_t srclen,
+		       void *dst, size_t dstlen);
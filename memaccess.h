@@ -0,0 +1,130 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Accesses of a given width (1, 2, 4 or 8 bytes) to mapped memory. They
+ * are volatile, so each one is done exactly once and with the requested
+ * width, which matters for registers.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+static inline uint64_t mem_read(const volatile void *p, int width)
+{
+	switch (width) {
+	case 1:
+		return *(const volatile uint8_t *)p;
+	case 2:
+		return *(const volatile uint16_t *)p;
+	case 4:
+		return *(const volatile uint32_t *)p;
+	default:
+		return *(const volatile uint64_t *)p;
+	}
+}
+
+static inline void mem_write(volatile void *p, uint64_t val, int width)
+{
+	switch (width) {
+	case 1:
+		*(volatile uint8_t *)p = val;
+		break;
+	case 2:
+		*(volatile uint16_t *)p = val;
+		break;
+	case 4:
+		*(volatile uint32_t *)p = val;
+		break;
+	default:
+		*(volatile uint64_t *)p = val;
+		break;
+	}
+}
+
+/*
+ * Copy the whole values in nbytes from the mapping src to the buffer dst
+ * or from the buffer src to the mapping dst. Only the accesses to the
+ * mapping are volatile, so the compiler is free to optimize the buffer
+ * side. Returns the number of bytes copied.
+ */
+static inline size_t mem_copy_from(void *dst, const volatile void *src,
+				   size_t nbytes, int width)
+{
+	size_t i, n = nbytes / width;
+
+	switch (width) {
+	case 1:
+		for (i = 0; i < n; i++)
+			((uint8_t *)dst)[i] = ((const volatile uint8_t *)src)[i];
+		break;
+	case 2:
+		for (i = 0; i < n; i++)
+			((uint16_t *)dst)[i] = ((const volatile uint16_t *)src)[i];
+		break;
+	case 4:
+		for (i = 0; i < n; i++)
+			((uint32_t *)dst)[i] = ((const volatile uint32_t *)src)[i];
+		break;
+	default:
+		for (i = 0; i < n; i++)
+			((uint64_t *)dst)[i] = ((const volatile uint64_t *)src)[i];
+		break;
+	}
+
+	return n * width;
+}
+
+static inline size_t mem_copy_to(volatile void *dst, const void *src,
+				 size_t nbytes, int width)
+{
+	size_t i, n = nbytes / width;
+
+	switch (width) {
+	case 1:
+		for (i = 0; i < n; i++)
+			((volatile uint8_t *)dst)[i] = ((const uint8_t *)src)[i];
+		break;
+	case 2:
+		for (i = 0; i < n; i++)
+			((volatile uint16_t *)dst)[i] = ((const uint16_t *)src)[i];
+		break;
+	case 4:
+		for (i = 0; i < n; i++)
+			((volatile uint32_t *)dst)[i] = ((const uint32_t *)src)[i];
+		break;
+	default:
+		for (i = 0; i < n; i++)
+			((volatile uint64_t *)dst)[i] = ((const uint64_t *)src)[i];
+		break;
+	}
+
+	return n * width;
+}
+
+#define MEM_BLOCK	64
+
+/*
+ * Returns non-zero if the MEM_BLOCK bytes at a and b (both 8 byte aligned)
+ * differ. The words are or'ed together without branches so the compiler
+ * can turn the loop into vector instructions.
+ */
+static inline uint64_t mem_block_diff(const void *a, const void *b)
+{
+	const uint64_t *p = a, *q = b;
+	uint64_t diff = 0;
+	int i;
+
+	for (i = 0; i < MEM_BLOCK / 8; i++)
+		diff |= p[i] ^ q[i];
+
+	return diff;
+}
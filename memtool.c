@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <glob.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -27,10 +28,21 @@
 #include <ctype.h>
 #include <string.h>
 #include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 #include "fileaccess.h"
+#include "memaccess.h"
+#include "output.h"
+#include "zdump.h"
 
 #define DISP_LINE_LEN	16
+/* data read at once for a hexdump */
+#define DISP_BUF_SIZE	4096
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
 /*
  * Like strtoull() but handles an optional G, M, K or k
@@ -131,79 +143,410 @@ static int parse_area_spec(const char *str, off_t *start, size_t *size)
 	(((uint16_t)(x) & (uint16_t)0x00ffU) << 8) |			\
 	(((uint16_t)(x) & (uint16_t)0xff00U) >> 8)))
 
-static int memory_display(const void *addr, off_t offs,
-			  size_t nbytes, int width, int swab)
+static uint64_t swab_value(uint64_t val, int width)
+{
+	switch (width) {
+	case 2:
+		return swab16(val);
+	case 4:
+		return swab32(val);
+	case 8:
+		return swab64(val);
+	default:
+		return val;
+	}
+}
+
+/*
+ * Copy nbytes from src to dst, swapping the bytes of each width sized
+ * element on the way. src and dst may be identical.
+ */
+static void swab_copy(void *dst, const void *src, size_t nbytes, int width)
+{
+	size_t i;
+
+	for (i = 0; i < nbytes / width; i++) {
+		switch (width) {
+		case 1:
+			((uint8_t *)dst)[i] = ((uint8_t *)src)[i];
+			break;
+		case 2:
+			((uint16_t *)dst)[i] = swab16(((uint16_t *)src)[i]);
+			break;
+		case 4:
+			((uint32_t *)dst)[i] = swab32(((uint32_t *)src)[i]);
+			break;
+		case 8:
+			((uint64_t *)dst)[i] = swab64(((uint64_t *)src)[i]);
+			break;
+		}
+	}
+}
+
+#define RAW_CHUNK	(1024 * 1024)
+#define SPARSE_BLOCK	4096
+
+static int full_write(int fd, const void *buf, size_t nbytes)
+{
+	ssize_t ret;
+
+	while (nbytes) {
+		ret = write(fd, buf, nbytes);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return -1;
+		}
+		buf += ret;
+		nbytes -= ret;
+	}
+
+	return 0;
+}
+
+/* Check if len bytes at buf (which must be 8 byte aligned) are all zero */
+static int is_zero(const void *buf, size_t len)
+{
+	static const uint64_t zeros[MEM_BLOCK / 8];
+	const uint8_t *p = buf, *end = p + len;
+
+	for (; end - p >= MEM_BLOCK; p += MEM_BLOCK)
+		if (mem_block_diff(p, zeros))
+			return 0;
+
+	for (; p < end; p++)
+		if (*p)
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Write raw data to fd. If sparse is set, SPARSE_BLOCK sized blocks that
+ * only contain zeros are skipped with lseek to create holes. The caller
+ * has to ftruncate the file at the end in case it ends with a hole.
+ */
+static int raw_write(int fd, const void *buf, size_t nbytes, int sparse)
+{
+	size_t pos = 0, len, data = 0;
+
+	if (!sparse)
+		return full_write(fd, buf, nbytes);
+
+	while (pos < nbytes) {
+		len = nbytes - pos;
+		if (len > SPARSE_BLOCK)
+			len = SPARSE_BLOCK;
+
+		if (!is_zero(buf + pos, len)) {
+			pos += len;
+			continue;
+		}
+
+		/* flush pending data blocks before skipping this one */
+		if (full_write(fd, buf + data, pos - data))
+			return -1;
+
+		if (lseek(fd, len, SEEK_CUR) < 0) {
+			perror("lseek");
+			return -1;
+		}
+
+		pos += len;
+		data = pos;
+	}
+
+	return full_write(fd, buf + data, pos - data);
+}
+
+/* Output nbytes of zeros, see raw_write() */
+static int raw_skip(int fd, size_t nbytes, int sparse)
+{
+	static const char zeros[SPARSE_BLOCK];
+	size_t len;
+
+	if (sparse) {
+		if (lseek(fd, nbytes, SEEK_CUR) < 0) {
+			perror("lseek");
+			return -1;
+		}
+		return 0;
+	}
+
+	while (nbytes) {
+		len = nbytes > sizeof(zeros) ? sizeof(zeros) : nbytes;
+		if (full_write(fd, zeros, len))
+			return -1;
+		nbytes -= len;
+	}
+
+	return 0;
+}
+
+static void memory_display(struct outbuf *out, const void *addr, off_t offs,
+			   size_t nbytes, int width, int swab)
 {
+	static const char spaces[] = "                                                    ";
+	const uint8_t *cp = addr;
+	char ascii[DISP_LINE_LEN];
 	size_t linebytes, i;
-	u_char	*cp;
+	uint64_t val;
+	int digits, count;
 
-	/* Print the lines.
-	 *
-	 * We buffer all read data, so we can make sure data is read only
-	 * once, and all accesses are with the specified bus width.
+	/*
+	 * Print the lines. The data is already in memory, so it is formatted
+	 * into out directly instead of going through stdio.
 	 */
 	do {
-		char linebuf[DISP_LINE_LEN];
-		uint64_t *uqp = (uint64_t *)linebuf;
-		uint32_t *uip = (uint32_t *)linebuf;
-		uint16_t *usp = (uint16_t *)linebuf;
-		uint8_t *ucp = (uint8_t *)linebuf;
-		unsigned count = 52;
-
-		printf("%08llx:", (unsigned long long)offs);
 		linebytes = (nbytes > DISP_LINE_LEN) ? DISP_LINE_LEN : nbytes;
+		count = sizeof(spaces) - 1;
+
+		/* like "%08llx" */
+		for (digits = 8; digits < 16 &&
+		     (unsigned long long)offs >> (4 * digits); digits++)
+			;
+		out_hex(out, offs, digits);
+		out_write(out, ":", 1);
 
 		for (i = 0; i < linebytes; i += width) {
-			if (width == 8) {
-				uint64_t res;
-				res = (*uqp++ = *((uint64_t *)addr));
-				if (swab)
-					res = swab64(res);
-				count -= printf(" %016" PRIx64, res);
-			} else if (width == 4) {
-				uint32_t res;
-				res = (*uip++ = *((uint *)addr));
-				if (swab)
-					res = swab32(res);
-				count -= printf(" %08" PRIx32, res);
-			} else if (width == 2) {
-				uint16_t res;
-				res = (*usp++ = *((ushort *)addr));
-				if (swab)
-					res = swab16(res);
-				count -= printf(" %04" PRIx16, res);
-			} else {
-				count -= printf(" %02x", (*ucp++ = *((u_char *)addr)));
-			}
-			addr += width;
-			offs += width;
+			val = mem_read(cp + i, width);
+			if (swab)
+				val = swab_value(val, width);
+			out_write(out, " ", 1);
+			out_hex(out, val, 2 * width);
+			count -= 1 + 2 * width;
 		}
 
-		while (count--)
-			putchar(' ');
+		out_write(out, spaces, count);
 
-		cp = (uint8_t *)linebuf;
-		for (i = 0; i < linebytes; i++) {
-			if ((*cp < 0x20) || (*cp > 0x7e))
-				putchar('.');
-			else
-				printf("%c", *cp);
-			cp++;
-		}
+		for (i = 0; i < linebytes; i++)
+			ascii[i] = (cp[i] < 0x20 || cp[i] > 0x7e) ? '.' : cp[i];
+		out_write(out, ascii, linebytes);
+		out_write(out, "\n", 1);
 
-		putchar('\n');
+		cp += linebytes;
+		offs += linebytes;
 		nbytes -= linebytes;
 	} while (nbytes > 0);
+}
+
+/* like memory_display() but using one of the structured output formats */
+static void memory_records(struct outbuf *out, int format, const char *target,
+			   const void *buf, off_t offs, size_t nbytes,
+			   int width, int swab)
+{
+	uint64_t val;
+	size_t i;
+
+	for (i = 0; i < nbytes; i += width) {
+		val = mem_read(buf + i, width);
+		if (swab)
+			val = swab_value(val, width);
+
+		out_record(out, format, target, offs + i, val, width);
+	}
+}
+
+/*
+ * Support for running md or mw on several targets in parallel. The
+ * results are collected per target and shown in the order the targets
+ * were given.
+ */
+#define TARGETS_JOBS	64
+
+struct target {
+	char *spec;
+	void *buf;
+	int ret;
+};
+
+struct targets {
+	struct target *t;
+	size_t num;
+	/* parameters of the operation */
+	off_t start;
+	size_t size;
+	int width;
+	void *data;
+	/* work distribution */
+	pthread_mutex_t lock;
+	size_t next;
+	int (*op)(struct targets *targets, struct target *t);
+};
+
+static int targets_append(struct targets *targets, const char *spec)
+{
+	struct target *t;
+
+	t = realloc(targets->t, (targets->num + 1) * sizeof(*t));
+	if (!t)
+		return -1;
+	targets->t = t;
+
+	t = &targets->t[targets->num];
+	memset(t, 0, sizeof(*t));
+	t->spec = strdup(spec);
+	if (!t->spec)
+		return -1;
+
+	targets->num++;
 
 	return 0;
 }
 
+/*
+ * Add the targets in list, which is a comma separated list of specs.
+ * Specs containing wildcards are expanded with glob(3) and must match
+ * something, all others (like mdio:eth0.1) are taken as they are.
+ */
+static int targets_add(struct targets *targets, const char *list)
+{
+	char *str, *spec, *saveptr;
+	glob_t g;
+	size_t i;
+	int ret = 0;
+
+	str = strdup(list);
+	if (!str)
+		goto err_nomem;
+
+	for (spec = strtok_r(str, ",", &saveptr); spec && !ret;
+	     spec = strtok_r(NULL, ",", &saveptr)) {
+		if (!strpbrk(spec, "*?[")) {
+			ret = targets_append(targets, spec);
+			continue;
+		}
+
+		ret = glob(spec, 0, NULL, &g);
+		if (ret == GLOB_NOMATCH) {
+			fprintf(stderr, "%s: no match\n", spec);
+			free(str);
+			return -1;
+		}
+		if (ret) {
+			ret = -1;
+			break;
+		}
+
+		for (i = 0; i < g.gl_pathc && !ret; i++)
+			ret = targets_append(targets, g.gl_pathv[i]);
+
+		globfree(&g);
+	}
+
+	free(str);
+	if (!ret)
+		return 0;
+
+err_nomem:
+	fprintf(stderr, "could not allocate memory\n");
+	return -1;
+}
+
+static void targets_free(struct targets *targets)
+{
+	size_t i;
+
+	for (i = 0; i < targets->num; i++) {
+		free(targets->t[i].spec);
+		free(targets->t[i].buf);
+	}
+
+	free(targets->t);
+}
+
+static void *targets_worker(void *arg)
+{
+	struct targets *targets = arg;
+	struct target *t;
+
+	for (;;) {
+		pthread_mutex_lock(&targets->lock);
+		t = targets->next < targets->num ?
+			&targets->t[targets->next++] : NULL;
+		pthread_mutex_unlock(&targets->lock);
+
+		if (!t)
+			return NULL;
+
+		t->ret = targets->op(targets, t);
+	}
+}
+
+/* run op on all targets using up to jobs threads */
+static void targets_run(struct targets *targets, long jobs)
+{
+	pthread_t *threads;
+	long i, n = 0;
+
+	if (jobs > targets->num)
+		jobs = targets->num;
+
+	pthread_mutex_init(&targets->lock, NULL);
+	targets->next = 0;
+
+	threads = calloc(jobs, sizeof(*threads));
+	for (i = 0; threads && i < jobs - 1; i++, n++)
+		if (pthread_create(&threads[n], NULL, targets_worker, targets))
+			break;
+
+	/* the calling thread takes part, too */
+	targets_worker(targets);
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&targets->lock);
+}
+
+static int md_target(struct targets *targets, struct target *t)
+{
+	void *handle;
+	ssize_t ret;
+
+	t->buf = malloc(targets->size);
+	if (!t->buf) {
+		fprintf(stderr, "could not allocate memory\n");
+		return -1;
+	}
+
+	handle = memtool_open(t->spec, O_RDONLY);
+	if (!handle)
+		return -1;
+
+	ret = memtool_read(handle, targets->start, t->buf, targets->size,
+			   targets->width);
+
+	memtool_close(handle);
+
+	return ret == targets->size ? 0 : -1;
+}
+
+static int mw_target(struct targets *targets, struct target *t)
+{
+	void *handle;
+	ssize_t ret;
+
+	handle = memtool_open(t->spec, O_RDWR | O_CREAT);
+	if (!handle)
+		return -1;
+
+	ret = memtool_write(handle, targets->start, targets->data,
+			    targets->size, targets->width);
+
+	memtool_close(handle);
+
+	return ret == targets->size ? 0 : -1;
+}
+
 static void usage_md(void)
 {
 	printf(
 "md - memory display\n"
 "\n"
-"Usage: md [-bwlqsx] REGION\n"
+"Usage: md [-bwlqsxoz] [--format=FORMAT] [--targets=LIST] [-j <JOBS>] REGION\n"
 "\n"
 "Display (hex dump) a memory region.\n"
 "\n"
@@ -214,6 +557,19 @@ static void usage_md(void)
 "  -q        quad access (64 bit)\n"
 "  -s <FILE> display file (default /dev/mem)\n"
 "  -x        swap bytes at output\n"
+"  -o <FILE> write raw data to FILE (- for stdout) instead of a hexdump\n"
+"  -z        compress the raw data, see 'memtool unpack'\n"
+"  --format=<hexdump|jsonl|csv|bin>\n"
+"            output format (default hexdump), see memtool(1)\n"
+"  --targets=<LIST>\n"
+"            display the region of all files in the comma separated\n"
+"            LIST instead of a single one, wildcards are expanded\n"
+"  -j <JOBS> number of targets to access in parallel (default 64) or\n"
+"            threads to compress with (default: number of cpus)\n"
+"\n"
+"Holes in sparse files are shown as a single line followed by '*'.\n"
+"Zero filled blocks are not written to a regular FILE, so it becomes\n"
+"sparse.\n"
 "\n"
 "Memory regions can be specified in two different forms: START+SIZE\n"
 "or START-END, If START is omitted it defaults to 0x100\n"
@@ -223,8 +579,68 @@ static void usage_md(void)
 
 }
 
+static int md_targets(struct targets *targets, long jobs, off_t start,
+		      size_t size, int width, int swap, int format)
+{
+	static struct outbuf out;
+	size_t i;
+	int ret = 0;
+
+	targets->start = start;
+	targets->size = size;
+	targets->width = width;
+	targets->op = md_target;
+
+	targets_run(targets, jobs);
+
+	out_init(&out, STDOUT_FILENO);
+	if (format != OUT_HEXDUMP)
+		out_header(&out, format, 1);
+
+	for (i = 0; i < targets->num; i++) {
+		struct target *t = &targets->t[i];
+
+		if (t->ret < 0) {
+			out_flush(&out);
+			fprintf(stderr, "%s: failed to read\n", t->spec);
+			ret = -1;
+			continue;
+		}
+
+		if (format != OUT_HEXDUMP) {
+			memory_records(&out, format, t->spec, t->buf, start,
+				       size, width, swap);
+			continue;
+		}
+
+		out_str(&out, i ? "\n==> " : "==> ");
+		out_str(&out, t->spec);
+		out_str(&out, " <==\n");
+		memory_display(&out, t->buf, start, size, width, swap);
+	}
+
+	if (out_flush(&out))
+		ret = -1;
+
+	targets_free(targets);
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 static int cmd_memory_display(int argc, char **argv)
 {
+	static const struct option long_options[] = {
+		{ "format", required_argument, NULL, 'F' },
+		{ "targets", required_argument, NULL, 'T' },
+		{ }
+	};
+	static const char zeros[DISP_LINE_LEN];
+	static char dispbuf[DISP_BUF_SIZE];
+	static struct outbuf out;
+	struct targets targets = { 0, };
+	struct zdump *zdump = NULL;
+	long jobs = 0;
+	int format = OUT_HEXDUMP;
 	int opt;
 	int width = 4;
 	size_t bufsize, size = 0x100;
@@ -232,9 +648,14 @@ static int cmd_memory_display(int argc, char **argv)
 	void *handle;
 	off_t start = 0x0;
 	char *file = "/dev/mem";
+	char *outfile = NULL;
+	int outfd = -1, sparse = 0;
+	int compress = 0;
 	int swap = 0;
+	int ret = 0;
 
-	while ((opt = getopt(argc, argv, "bwlqs:xh")) != -1) {
+	while ((opt = getopt_long(argc, argv, "bwlqs:xo:zj:h", long_options,
+				  NULL)) != -1) {
 		switch (opt) {
 		case 'b':
 			width = 1;
@@ -254,6 +675,24 @@ static int cmd_memory_display(int argc, char **argv)
 		case 'x':
 			swap = 1;
 			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'z':
+			compress = 1;
+			break;
+		case 'F':
+			format = out_parse_format(optarg);
+			if (format < 0)
+				return EXIT_FAILURE;
+			break;
+		case 'T':
+			if (targets_add(&targets, optarg))
+				return EXIT_FAILURE;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
 		case 'h':
 			usage_md();
 			return 0;
@@ -275,35 +714,133 @@ static int cmd_memory_display(int argc, char **argv)
 			size);
 	}
 
+	if (outfile && format != OUT_HEXDUMP) {
+		fprintf(stderr, "-o and --format cannot be combined\n");
+		return EXIT_FAILURE;
+	}
+
+	if (compress && !outfile) {
+		fprintf(stderr, "-z needs -o\n");
+		return EXIT_FAILURE;
+	}
+
 	if (!size)
 		return EXIT_SUCCESS;
 
+	if (targets.num) {
+		if (outfile) {
+			fprintf(stderr, "-o and --targets cannot be combined\n");
+			return EXIT_FAILURE;
+		}
+		/* bin records have no room to tell the targets apart */
+		if (format == OUT_BIN) {
+			fprintf(stderr, "--format=bin and --targets cannot be combined\n");
+			return EXIT_FAILURE;
+		}
+		return md_targets(&targets, jobs ? jobs : TARGETS_JOBS, start,
+				  size, width, swap, format);
+	}
+
 	bufsize = size;
-	if (bufsize > 4096)
-		bufsize = 4096;
+	if (format == OUT_HEXDUMP && !outfile) {
+		/* a hexdump is produced in small steps, no need to allocate */
+		if (bufsize > sizeof(dispbuf))
+			bufsize = sizeof(dispbuf);
+		buf = dispbuf;
+	} else {
+		if (bufsize > RAW_CHUNK)
+			bufsize = RAW_CHUNK;
+
+		buf = malloc(bufsize);
+		if (!buf) {
+			fprintf(stderr, "could not allocate memory\n");
+			return EXIT_FAILURE;
+		}
+	}
 
-	buf = malloc(bufsize);
-	if (!buf) {
-		fprintf(stderr, "could not allocate memory\n");
-		return EXIT_FAILURE;
+	if (outfile && !strcmp(outfile, "-")) {
+		outfd = STDOUT_FILENO;
+	} else if (outfile) {
+		struct stat s;
+
+		outfd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (outfd < 0) {
+			perror("open");
+			return EXIT_FAILURE;
+		}
+
+		sparse = !fstat(outfd, &s) && S_ISREG(s.st_mode);
+	}
+
+	if (compress) {
+		if (!jobs)
+			jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+		zdump = zdump_create(outfd, start, RAW_CHUNK, jobs);
+		if (!zdump)
+			return EXIT_FAILURE;
+		sparse = 0;
 	}
 
 	handle = memtool_open(file, O_RDONLY);
 	if (!handle)
 		return EXIT_FAILURE;
 
+	out_init(&out, STDOUT_FILENO);
+	if (format != OUT_HEXDUMP)
+		out_header(&out, format, 0);
+
 	while (size) {
-		int ret;
+		size_t hole;
 
 		if (size < bufsize)
 			bufsize = size;
 
+		hole = memtool_hole_size(handle, start, size);
+		if (outfd >= 0 && !zdump && (hole &= ~(width - 1))) {
+			ret = raw_skip(outfd, hole, sparse);
+			if (ret)
+				break;
+
+			start += hole;
+			size -= hole;
+			continue;
+		}
+
+		hole &= ~(DISP_LINE_LEN - 1);
+		if (outfd < 0 && format == OUT_HEXDUMP &&
+		    hole >= 2 * DISP_LINE_LEN) {
+			memory_display(&out, zeros, start, DISP_LINE_LEN, width,
+				       swap);
+			out_str(&out, "*\n");
+
+			start += hole;
+			size -= hole;
+			continue;
+		}
+
 		ret = memtool_read(handle, start, buf, bufsize, width);
 		if (ret < 0)
-			return EXIT_FAILURE;
+			break;
 
 		assert(ret == bufsize);
-		memory_display(buf, start, bufsize, width, swap);
+		ret = 0;
+
+		if (outfd >= 0) {
+			if (swap)
+				swab_copy(buf, buf, bufsize, width);
+			if (zdump)
+				ret = zdump_write(zdump, buf, bufsize);
+			else
+				ret = raw_write(outfd, buf, bufsize, sparse);
+			if (ret)
+				break;
+		} else if (format != OUT_HEXDUMP) {
+			memory_records(&out, format, NULL, buf, start, bufsize,
+				       width, swap);
+		} else {
+			memory_display(&out, buf, start, bufsize, width, swap);
+		}
 
 		start += bufsize;
 		size -= bufsize;
@@ -311,7 +848,29 @@ static int cmd_memory_display(int argc, char **argv)
 
 	memtool_close(handle);
 
-	return EXIT_SUCCESS;
+	if (out_flush(&out))
+		ret = -1;
+
+	if (zdump && zdump_finish(zdump))
+		ret = -1;
+
+	if (outfd >= 0) {
+		/* the output might end with a hole, set the final size */
+		if (!ret && sparse &&
+		    ftruncate(outfd, lseek(outfd, 0, SEEK_CUR))) {
+			perror("ftruncate");
+			ret = -1;
+		}
+		if (close(outfd)) {
+			perror("close");
+			ret = -1;
+		}
+	}
+
+	if (buf != dispbuf)
+		free(buf);
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 static void usage_mw(void)
@@ -319,7 +878,7 @@ static void usage_mw(void)
 	printf(
 "mw - memory write\n"
 "\n"
-"Usage: mw [-bwlqd] OFFSET DATA...\n"
+"Usage: mw [-bwlqd] [--targets=LIST [-j <JOBS>]] OFFSET DATA...\n"
 "\n"
 "Write DATA value(s) to the specified REGION.\n"
 "\n"
@@ -329,11 +888,48 @@ static void usage_mw(void)
 "  -l        long access (32 bit)\n"
 "  -q        quad access (64 bit)\n"
 "  -d <FILE> write file (default /dev/mem)\n"
+"  --targets=<LIST>\n"
+"            write to all files in the comma separated LIST instead of a\n"
+"            single one, wildcards are expanded\n"
+"  -j <JOBS> number of targets to access in parallel (default 64)\n"
 	);
 }
 
+static int mw_targets(struct targets *targets, long jobs, off_t adr,
+		      void *buf, size_t size, int width)
+{
+	size_t i;
+	int ret = 0;
+
+	targets->start = adr;
+	targets->size = size;
+	targets->width = width;
+	targets->data = buf;
+	targets->op = mw_target;
+
+	targets_run(targets, jobs);
+
+	for (i = 0; i < targets->num; i++) {
+		if (targets->t[i].ret < 0) {
+			fprintf(stderr, "%s: failed to write\n",
+				targets->t[i].spec);
+			ret = -1;
+		}
+	}
+
+	targets_free(targets);
+
+	return ret;
+}
+
 static int cmd_memory_write(int argc, char *argv[])
 {
+	static const struct option long_options[] = {
+		{ "targets", required_argument, NULL, 'T' },
+		{ }
+	};
+	struct targets targets = { 0, };
+	long jobs = TARGETS_JOBS;
 	off_t adr;
 	size_t bufsize, size;
 	char *buf;
@@ -343,7 +939,8 @@ static int cmd_memory_write(int argc, char *argv[])
 	int i, ret;
 	char *file = "/dev/mem";
 
-	while ((opt = getopt(argc, argv, "bwlqd:h")) != -1) {
+	while ((opt = getopt_long(argc, argv, "bwlqd:j:h", long_options,
+				  NULL)) != -1) {
 		switch (opt) {
 		case 'b':
 			width = 1;
@@ -360,6 +957,13 @@ static int cmd_memory_write(int argc, char *argv[])
 		case 'd':
 			file = optarg;
 			break;
+		case 'T':
+			if (targets_add(&targets, optarg))
+				return EXIT_FAILURE;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
 		case 'h':
 			usage_mw();
 			return 0;
@@ -377,8 +981,9 @@ static int cmd_memory_write(int argc, char *argv[])
 	if (!size)
 		return EXIT_SUCCESS;
 
+	/* all targets get the same data, so parse it only once */
 	bufsize = size;
-	if (bufsize > 4096)
+	if (bufsize > 4096 && !targets.num)
 		bufsize = 4096;
 
 	buf = malloc(bufsize);
@@ -387,9 +992,13 @@ static int cmd_memory_write(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	handle = memtool_open(file, O_RDWR | O_CREAT);
-	if (!handle)
-		return EXIT_FAILURE;
+	if (targets.num) {
+		handle = NULL;
+	} else {
+		handle = memtool_open(file, O_RDWR | O_CREAT);
+		if (!handle)
+			return EXIT_FAILURE;
+	}
 
 	while (optind < argc) {
 		i = 0;
@@ -417,6 +1026,11 @@ static int cmd_memory_write(int argc, char *argv[])
 			++optind;
 		}
 
+		if (targets.num) {
+			ret = mw_targets(&targets, jobs, adr, buf, size, width);
+			break;
+		}
+
 		ret = memtool_write(handle, adr, buf, i * width, width);
 		if (ret < 0)
 			break;
@@ -426,29 +1040,2104 @@ static int cmd_memory_write(int argc, char *argv[])
 	}
 
 
-	memtool_close(handle);
+	if (handle)
+		memtool_close(handle);
 	free(buf);
 
 	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-struct cmd {
-	int (*cmd)(int argc, char **argv);
-	const char *name;
-};
-
-#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define LOAD_CHUNK	(1024 * 1024)
 
-static struct cmd cmds[] = {
+static void usage_load(void)
+{
+	printf(
+"load - load a file into memory\n"
+"\n"
+"Usage: load [-bwlqxv] [-d <FILE>] SOURCE OFFSET\n"
+"\n"
+"Write the contents of SOURCE to memory starting at OFFSET.\n"
+"If SOURCE is - the data is read from stdin.\n"
+"\n"
+"Options:\n"
+"  -b        byte access\n"
+"  -w        word access (16 bit)\n"
+"  -l        long access (32 bit)\n"
+"  -q        quad access (64 bit)\n"
+"  -d <FILE> write file (default /dev/mem)\n"
+"  -x        swap bytes before writing\n"
+"  -v        verify data after writing\n"
+	);
+}
+
+/*
+ * Read up to bufsize bytes from fd. Only returns less than bufsize when
+ * the end of the input is reached.
+ */
+static ssize_t read_full(int fd, void *buf, size_t bufsize)
+{
+	size_t pos = 0;
+	ssize_t ret;
+
+	while (pos < bufsize) {
+		ret = read(fd, buf + pos, bufsize - pos);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			return -1;
+		}
+		if (!ret)
+			break;
+		pos += ret;
+	}
+
+	return pos;
+}
+
+static int load_chunk(void *handle, off_t adr, const void *data,
+		      size_t len, int width, char *verbuf)
+{
+	ssize_t ret;
+	size_t i;
+
+	ret = memtool_write(handle, adr, data, len, width);
+	if (ret < 0)
+		return -1;
+
+	assert(ret == len);
+
+	if (!verbuf)
+		return 0;
+
+	ret = memtool_read(handle, adr, verbuf, len, width);
+	if (ret < 0)
+		return -1;
+
+	if (ret == len && !memcmp(verbuf, data, len))
+		return 0;
+
+	for (i = 0; i < ret; i += width)
+		if (memcmp(verbuf + i, data + i, width))
+			break;
+
+	fprintf(stderr, "verify failed at 0x%llx\n",
+		(unsigned long long)(adr + i));
+
+	return -1;
+}
+
+static int cmd_load(int argc, char **argv)
+{
+	off_t adr;
+	size_t size = 0, pos, len;
+	char *buf = NULL, *verbuf = NULL;
+	void *map = MAP_FAILED;
+	void *handle;
+	struct stat s;
+	int width = 4;
+	int swap = 0, verify = 0;
+	int opt, fd;
+	int ret = -1;
+	char *file = "/dev/mem";
+
+	while ((opt = getopt(argc, argv, "bwlqd:xvh")) != -1) {
+		switch (opt) {
+		case 'b':
+			width = 1;
+			break;
+		case 'w':
+			width = 2;
+			break;
+		case 'l':
+			width = 4;
+			break;
+		case 'q':
+			width = 8;
+			break;
+		case 'd':
+			file = optarg;
+			break;
+		case 'x':
+			swap = 1;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 'h':
+			usage_load();
+			return 0;
+		}
+	}
+
+	if (optind + 2 != argc) {
+		fprintf(stderr, "Wrong number of parameters for load\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!strcmp(argv[optind], "-")) {
+		fd = STDIN_FILENO;
+	} else {
+		fd = open(argv[optind], O_RDONLY);
+		if (fd < 0) {
+			perror("open");
+			return EXIT_FAILURE;
+		}
+	}
+
+	adr = strtoull_suffix(argv[optind + 1], NULL, 0);
+
+	if (fstat(fd, &s)) {
+		perror("fstat");
+		goto out_close;
+	}
+
+	/*
+	 * Regular files are mapped as a whole and handed to the backend
+	 * without an intermediate copy. Everything else is streamed.
+	 */
+	if (S_ISREG(s.st_mode) && s.st_size > 0) {
+		size = s.st_size;
+
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			goto out_close;
+		}
+
+		madvise(map, size, MADV_SEQUENTIAL);
+
+		if (size & (width - 1)) {
+			size &= ~(width - 1);
+			fprintf(stderr,
+				"warning: skipping truncated write, size=%zu\n",
+				size);
+		}
+	}
+
+	if (map == MAP_FAILED || swap) {
+		buf = malloc(LOAD_CHUNK);
+		if (!buf) {
+			fprintf(stderr, "could not allocate memory\n");
+			goto out_unmap;
+		}
+	}
+
+	if (verify) {
+		verbuf = malloc(LOAD_CHUNK);
+		if (!verbuf) {
+			fprintf(stderr, "could not allocate memory\n");
+			goto out_unmap;
+		}
+	}
+
+	handle = memtool_open(file, O_RDWR | O_CREAT);
+	if (!handle)
+		goto out_unmap;
+
+	if (map != MAP_FAILED) {
+		ret = 0;
+
+		for (pos = 0; pos < size && !ret; pos += len) {
+			const void *data = map + pos;
+
+			len = size - pos;
+			if (len > LOAD_CHUNK)
+				len = LOAD_CHUNK;
+
+			if (swap) {
+				swab_copy(buf, data, len, width);
+				data = buf;
+			}
+
+			ret = load_chunk(handle, adr + pos, data, len, width,
+					 verbuf);
+		}
+	} else {
+		for (pos = 0; ; pos += len) {
+			ssize_t n = read_full(fd, buf, LOAD_CHUNK);
+
+			if (n < 0) {
+				ret = -1;
+				break;
+			}
+
+			len = n & ~(width - 1);
+			if (len != n)
+				fprintf(stderr,
+					"warning: skipping truncated write, size=%zu\n",
+					pos + len);
+
+			ret = 0;
+			if (!len)
+				break;
+
+			if (swap)
+				swab_copy(buf, buf, len, width);
+
+			ret = load_chunk(handle, adr + pos, buf, len, width,
+					 verbuf);
+			if (ret || len < LOAD_CHUNK)
+				break;
+		}
+	}
+
+	memtool_close(handle);
+
+out_unmap:
+	if (map != MAP_FAILED)
+		munmap(map, s.st_size);
+	free(verbuf);
+	free(buf);
+out_close:
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage_replay(void)
+{
+	printf(
+"replay - replay an access log\n"
+"\n"
+"Usage: replay [-ti] [-d <FILE>] LOG\n"
+"\n"
+"Repeat the reads and writes recorded in LOG. To record an access log set\n"
+"MEMTOOL_RECORD=LOG in the environment of other memtool commands.\n"
+"\n"
+"Options:\n"
+"  -d <FILE> target file (default /dev/mem)\n"
+"  -t        keep the original timing (default: as fast as possible)\n"
+"  -i        ignore the values returned by reads\n"
+	);
+}
+
+struct replay_op {
+	uint64_t delay;		/* ns after the first access */
+	off_t offset;
+	union {
+		uint8_t u8;
+		uint16_t u16;
+		uint32_t u32;
+		uint64_t u64;
+	} value;
+	uint8_t width;
+	uint8_t op;
+};
+
+/*
+ * Read and check the complete log before touching any hardware, so
+ * replaying only has to walk an array.
+ */
+static struct replay_op *replay_parse(const char *logfile, size_t *nops)
+{
+	const struct memtool_rec_header *hdr;
+	const struct memtool_rec *rec;
+	struct replay_op *ops = NULL;
+	struct stat s;
+	void *map;
+	size_t i, n;
+	int fd;
+
+	fd = open(logfile, O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		return NULL;
+	}
+
+	if (fstat(fd, &s)) {
+		perror("fstat");
+		goto out_close;
+	}
+
+	if (s.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "%s: not an access log\n", logfile);
+		goto out_close;
+	}
+
+	map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		goto out_close;
+	}
+
+	hdr = map;
+	if (hdr->magic != MEMTOOL_REC_MAGIC ||
+	    hdr->version != MEMTOOL_REC_VERSION) {
+		fprintf(stderr, "%s: not an access log\n", logfile);
+		goto out_unmap;
+	}
+
+	rec = map + sizeof(*hdr);
+	n = (s.st_size - sizeof(*hdr)) / sizeof(*rec);
+	if (n * sizeof(*rec) != s.st_size - sizeof(*hdr))
+		fprintf(stderr, "warning: ignoring truncated record\n");
+
+	ops = calloc(n ? n : 1, sizeof(*ops));
+	if (!ops) {
+		fprintf(stderr, "could not allocate memory\n");
+		goto out_unmap;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct replay_op *op = &ops[i];
+
+		if (rec[i].op != MEMTOOL_REC_READ &&
+		    rec[i].op != MEMTOOL_REC_WRITE) {
+			fprintf(stderr, "record %zu: invalid access\n", i);
+			goto out_free;
+		}
+
+		op->op = rec[i].op;
+		op->offset = rec[i].offset;
+		op->width = rec[i].width;
+		op->delay = rec[i].time > rec[0].time ?
+			rec[i].time - rec[0].time : 0;
+
+		if (op->width != 1 && op->width != 2 && op->width != 4 &&
+		    op->width != 8) {
+			fprintf(stderr, "record %zu: invalid width\n", i);
+			goto out_free;
+		}
+
+		mem_write(&op->value, rec[i].value, op->width);
+	}
+
+	*nops = n;
+	munmap(map, s.st_size);
+	close(fd);
+
+	return ops;
+
+out_free:
+	free(ops);
+	ops = NULL;
+out_unmap:
+	munmap(map, s.st_size);
+out_close:
+	close(fd);
+
+	return NULL;
+}
+
+static uint64_t replay_value(const struct replay_op *op, const void *val)
+{
+	return mem_read(val, op->width);
+}
+
+static int cmd_replay(int argc, char **argv)
+{
+	struct replay_op *ops;
+	struct timespec start, deadline;
+	size_t i, nops, mismatches = 0;
+	void *handle;
+	int timing = 0, check = 1;
+	int opt;
+	int ret = 0;
+	char *file = "/dev/mem";
+
+	while ((opt = getopt(argc, argv, "d:tih")) != -1) {
+		switch (opt) {
+		case 'd':
+			file = optarg;
+			break;
+		case 't':
+			timing = 1;
+			break;
+		case 'i':
+			check = 0;
+			break;
+		case 'h':
+			usage_replay();
+			return 0;
+		}
+	}
+
+	if (optind + 1 != argc) {
+		fprintf(stderr, "Wrong number of parameters for replay\n");
+		return EXIT_FAILURE;
+	}
+
+	ops = replay_parse(argv[optind], &nops);
+	if (!ops)
+		return EXIT_FAILURE;
+
+	handle = memtool_open(file, O_RDWR);
+	if (!handle) {
+		free(ops);
+		return EXIT_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < nops; i++) {
+		struct replay_op *op = &ops[i];
+		uint64_t val;
+
+		if (timing) {
+			deadline.tv_sec = start.tv_sec + op->delay / 1000000000;
+			deadline.tv_nsec = start.tv_nsec + op->delay % 1000000000;
+			if (deadline.tv_nsec >= 1000000000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &deadline, NULL) == EINTR)
+				;
+		}
+
+		if (op->op == MEMTOOL_REC_WRITE) {
+			ret = memtool_write(handle, op->offset, &op->value,
+					    op->width, op->width);
+			if (ret < 0)
+				break;
+			continue;
+		}
+
+		ret = memtool_read(handle, op->offset, &val, op->width,
+				   op->width);
+		if (ret < 0)
+			break;
+
+		if (check && memcmp(&val, &op->value, op->width)) {
+			fprintf(stderr,
+				"%08llx: expected 0x%" PRIx64 ", read 0x%" PRIx64 "\n",
+				(unsigned long long)op->offset,
+				replay_value(op, &op->value),
+				replay_value(op, &val));
+			mismatches++;
+		}
+	}
+
+	memtool_close(handle);
+	free(ops);
+
+	if (ret < 0)
+		return EXIT_FAILURE;
+
+	if (mismatches) {
+		fprintf(stderr, "%zu of %zu accesses differ\n", mismatches,
+			nops);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+#ifdef USE_MDIO
+static void usage_mdio_scan(void)
+{
+	printf(
+"mdio-scan - scan MDIO busses for phys\n"
+"\n"
+"Usage: mdio-scan [-n <NREGS>] IFNAME...\n"
+"\n"
+"Probe all 32 addresses on the MDIO bus of each network interface and\n"
+"dump the registers of all phys found. The interfaces are scanned in\n"
+"parallel.\n"
+"\n"
+"Options:\n"
+"  -n <NREGS> number of registers to dump per phy (default 32)\n"
+	);
+}
+
+struct mdio_scan_job {
+	struct mdio_scan scan;
+	pthread_t thread;
+	int ret;
+};
+
+static void *mdio_scan_thread(void *arg)
+{
+	struct mdio_scan_job *job = arg;
+
+	job->ret = mdio_scan(&job->scan);
+
+	return NULL;
+}
+
+static int cmd_mdio_scan(int argc, char **argv)
+{
+	static struct outbuf out;
+	struct mdio_scan_job *jobs;
+	unsigned int nregs = MDIO_NR_REGS;
+	unsigned int phy;
+	int i, njobs, opt;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nregs = strtoul(optarg, NULL, 0);
+			if (!nregs || nregs > MDIO_NR_REGS) {
+				fprintf(stderr, "invalid number of registers\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			usage_mdio_scan();
+			return 0;
+		}
+	}
+
+	njobs = argc - optind;
+	if (njobs < 1) {
+		fprintf(stderr, "No interface given\n");
+		return EXIT_FAILURE;
+	}
+
+	jobs = calloc(njobs, sizeof(*jobs));
+	if (!jobs) {
+		fprintf(stderr, "could not allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < njobs; i++) {
+		jobs[i].scan.ifname = argv[optind + i];
+		jobs[i].scan.nregs = nregs;
+
+		if (pthread_create(&jobs[i].thread, NULL, mdio_scan_thread,
+				   &jobs[i])) {
+			/* scan in this thread instead */
+			jobs[i].thread = pthread_self();
+			mdio_scan_thread(&jobs[i]);
+		}
+	}
+
+	out_init(&out, STDOUT_FILENO);
+
+	for (i = 0; i < njobs; i++) {
+		struct mdio_scan *scan = &jobs[i].scan;
+
+		if (!pthread_equal(jobs[i].thread, pthread_self()))
+			pthread_join(jobs[i].thread, NULL);
+
+		if (jobs[i].ret < 0) {
+			out_flush(&out);
+			fprintf(stderr, "%s: %s\n", scan->ifname,
+				strerror(-jobs[i].ret));
+			ret = EXIT_FAILURE;
+			continue;
+		}
+
+		for (phy = 0; phy < MDIO_NR_PHYS; phy++) {
+			if (!(scan->present & (1U << phy)))
+				continue;
+
+			out_str(&out, scan->ifname);
+			out_write(&out, ".", 1);
+			out_dec(&out, phy);
+			out_str(&out, ":\n");
+			memory_display(&out, scan->regs[phy], 0, 2 * nregs, 2, 0);
+		}
+	}
+
+	if (out_flush(&out))
+		ret = EXIT_FAILURE;
+
+	free(jobs);
+
+	return ret;
+}
+#endif
+
+static void usage_lat(void)
+{
+	printf(
+"lat - measure access latency\n"
+"\n"
+"Usage: lat [-bwlq] [-s <FILE>] [-n <COUNT>] [-W <COUNT>] REGION\n"
+"\n"
+"Time each read access in REGION and show the minimum, median, 99th\n"
+"percentile and maximum latency per offset and a histogram over all\n"
+"accesses. The overhead of reading the clock is subtracted.\n"
+"\n"
+"Options:\n"
+"  -b         byte access\n"
+"  -w         word access (16 bit)\n"
+"  -l         long access (32 bit)\n"
+"  -q         quad access (64 bit)\n"
+"  -s <FILE>  file to access (default /dev/mem)\n"
+"  -n <COUNT> number of timed accesses per offset (default 100)\n"
+"  -W <COUNT> number of untimed accesses per offset before (default 10)\n"
+	);
+}
+
+#define LAT_HIST_BUCKETS	32
+
+static inline uint64_t lat_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int cmd_lat(int argc, char **argv)
+{
+	unsigned long hist[LAT_HIST_BUCKETS] = { 0, };
+	unsigned long count = 100, warmup = 10, i, maxhist = 0;
+	uint64_t t, overhead = ~0ULL;
+	uint32_t *samples;
+	size_t size = 0x100, pos;
+	off_t start = 0x0;
+	char *file = "/dev/mem";
+	void *handle, *map;
+	uint64_t val;
+	int width = 4;
+	int opt, b;
+	int ret = 0;
+
+	while ((opt = getopt(argc, argv, "bwlqs:n:W:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			width = 1;
+			break;
+		case 'w':
+			width = 2;
+			break;
+		case 'l':
+			width = 4;
+			break;
+		case 'q':
+			width = 8;
+			break;
+		case 's':
+			file = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			warmup = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage_lat();
+			return 0;
+		}
+	}
+
+	if (optind < argc) {
+		if (parse_area_spec(argv[optind], &start, &size)) {
+			fprintf(stderr, "could not parse: %s\n", argv[optind]);
+			return EXIT_FAILURE;
+		}
+		if (size == ~0)
+			size = 0x100;
+	}
+
+	size &= ~(width - 1);
+	if (!size || !count)
+		return EXIT_SUCCESS;
+
+	samples = malloc(count * sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "could not allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	handle = memtool_open(file, O_RDONLY);
+	if (!handle) {
+		free(samples);
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * Access the mapping directly if possible, otherwise (e.g. for mdio)
+	 * time the complete memtool_read() call.
+	 */
+	map = memtool_map(handle, start, size, PROT_READ);
+	if (!map && errno != EOPNOTSUPP) {
+		ret = -1;
+		goto out;
+	}
+
+	for (i = 0; i < 1000; i++) {
+		t = lat_now();
+		t = lat_now() - t;
+		if (t < overhead)
+			overhead = t;
+	}
+
+	printf("clock overhead: %" PRIu64 " ns\n", overhead);
+	printf("offset         min   median      p99      max\n");
+
+	for (pos = 0; pos < size; pos += width) {
+		for (i = 0; i < warmup + count; i++) {
+			if (map) {
+				t = lat_now();
+				val = mem_read(map + pos, width);
+				t = lat_now() - t;
+			} else {
+				t = lat_now();
+				ret = memtool_read(handle, start + pos, &val,
+						   width, width);
+				t = lat_now() - t;
+				if (ret < 0)
+					goto out;
+			}
+
+			if (i < warmup)
+				continue;
+
+			t = t > overhead ? t - overhead : 0;
+			samples[i - warmup] = t > UINT32_MAX ? UINT32_MAX : t;
+
+			for (b = 0; b < LAT_HIST_BUCKETS - 1 && t >> b > 1; b++)
+				;
+			hist[b]++;
+		}
+
+		qsort(samples, count, sizeof(*samples), lat_cmp);
+
+		printf("%08llx: %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n",
+		       (unsigned long long)(start + pos), samples[0],
+		       samples[(count - 1) / 2],
+		       samples[(count * 99 + 99) / 100 - 1],
+		       samples[count - 1]);
+	}
+
+	for (b = 0; b < LAT_HIST_BUCKETS; b++)
+		if (hist[b] > maxhist)
+			maxhist = hist[b];
+
+	printf("\nhistogram (ns):\n");
+	for (b = 0; b < LAT_HIST_BUCKETS; b++) {
+		unsigned long lo = b ? 1UL << b : 0, hi = (2UL << b) - 1;
+		int bar;
+
+		if (!hist[b])
+			continue;
+
+		bar = (hist[b] * 50 + maxhist - 1) / maxhist;
+		printf("%10lu - %10lu: %10lu %.*s\n", lo, hi, hist[b], bar,
+		       "##################################################");
+	}
+
+	ret = 0;
+out:
+	if (map)
+		memtool_unmap(handle, map, size);
+	memtool_close(handle);
+	free(samples);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage_memtest(void)
+{
+	printf(
+"memtest - test memory\n"
+"\n"
+"Usage: memtest [-bwlq] [-d <FILE>] [-j <THREADS>] [-p <PASSES>] [-t <TESTS>] REGION\n"
+"\n"
+"Test the memory in REGION and report failing addresses and bits.\n"
+"The previous content of REGION is destroyed.\n"
+"\n"
+"Options:\n"
+"  -b           byte access\n"
+"  -w           word access (16 bit)\n"
+"  -l           long access (32 bit)\n"
+"  -q           quad access (64 bit)\n"
+"  -d <FILE>    file to test (default /dev/mem)\n"
+"  -j <THREADS> number of threads (default: number of online cpus)\n"
+"  -p <PASSES>  number of passes (default 1)\n"
+"  -t <TESTS>   comma separated list of tests to run (default: all)\n"
+"\n"
+"Tests:\n"
+"  data         walking ones and zeros on the data bus\n"
+"  addr         stuck and shorted address lines\n"
+"  march        March C- (in parallel on per thread subranges)\n"
+"  random       random patterns (in parallel on per thread subranges)\n"
+	);
+}
+
+#define MEMTEST_DATA		(1 << 0)
+#define MEMTEST_ADDR		(1 << 1)
+#define MEMTEST_MARCH		(1 << 2)
+#define MEMTEST_RANDOM		(1 << 3)
+#define MEMTEST_MAX_REPORT	10
+
+struct memtest {
+	void *handle;
+	volatile void *map;	/* only valid for the worker's subrange */
+	off_t start;
+	size_t nwords;
+	int width;
+	int tests;
+	unsigned int pass;
+	unsigned long errors;
+	pthread_t thread;
+};
+
+static inline void memtest_write(struct memtest *mt, size_t i, uint64_t val)
+{
+	mem_write(mt->map + i * mt->width, val, mt->width);
+}
+
+static inline uint64_t memtest_read(struct memtest *mt, size_t i)
+{
+	return mem_read(mt->map + i * mt->width, mt->width);
+}
+
+static uint64_t memtest_mask(int width)
+{
+	return width == 8 ? ~0ULL : (1ULL << (8 * width)) - 1;
+}
+
+static void memtest_fail(struct memtest *mt, const char *test, size_t i,
+			 uint64_t expected, uint64_t actual)
+{
+	int digits = 2 * mt->width;
+
+	if (mt->errors++ == MEMTEST_MAX_REPORT) {
+		fprintf(stderr, "%s: not reporting further errors at 0x%llx+\n",
+			test, (unsigned long long)mt->start);
+		return;
+	} else if (mt->errors > MEMTEST_MAX_REPORT) {
+		return;
+	}
+
+	fprintf(stderr, "%s: %08llx: expected 0x%0*" PRIx64 ", read 0x%0*" PRIx64
+		", bits 0x%0*" PRIx64 "\n", test,
+		(unsigned long long)(mt->start + i * mt->width),
+		digits, expected, digits, actual, digits, expected ^ actual);
+}
+
+static inline void memtest_check(struct memtest *mt, const char *test,
+				 size_t i, uint64_t expected)
+{
+	uint64_t val = memtest_read(mt, i);
+
+	if (val != expected)
+		memtest_fail(mt, test, i, expected, val);
+}
+
+/* walking ones and zeros on the first word */
+static void memtest_data(struct memtest *mt)
+{
+	uint64_t mask = memtest_mask(mt->width);
+	uint64_t val;
+	int bit;
+
+	for (bit = 0; bit < 8 * mt->width; bit++) {
+		val = 1ULL << bit;
+		memtest_write(mt, 0, val);
+		memtest_check(mt, "data", 0, val);
+
+		memtest_write(mt, 0, ~val & mask);
+		memtest_check(mt, "data", 0, ~val & mask);
+	}
+}
+
+/* detect address lines that are stuck high, stuck low or shorted */
+static void memtest_addr(struct memtest *mt)
+{
+	uint64_t pattern = 0xaaaaaaaaaaaaaaaaULL & memtest_mask(mt->width);
+	uint64_t anti = ~pattern & memtest_mask(mt->width);
+	size_t off, test;
+
+	for (off = 1; off < mt->nwords; off <<= 1)
+		memtest_write(mt, off, pattern);
+
+	memtest_write(mt, 0, anti);
+
+	for (off = 1; off < mt->nwords; off <<= 1)
+		memtest_check(mt, "addr", off, pattern);
+
+	memtest_write(mt, 0, pattern);
+
+	for (test = 1; test < mt->nwords; test <<= 1) {
+		memtest_write(mt, test, anti);
+		memtest_check(mt, "addr", 0, pattern);
+
+		for (off = 1; off < mt->nwords; off <<= 1)
+			if (off != test)
+				memtest_check(mt, "addr", off, pattern);
+
+		memtest_write(mt, test, pattern);
+	}
+}
+
+/* March C-: up(w0) up(r0,w1) up(r1,w0) down(r0,w1) down(r1,w0) up(r0) */
+static void memtest_march(struct memtest *mt)
+{
+	uint64_t one = memtest_mask(mt->width);
+	size_t i;
+
+	for (i = 0; i < mt->nwords; i++)
+		memtest_write(mt, i, 0);
+
+	for (i = 0; i < mt->nwords; i++) {
+		memtest_check(mt, "march", i, 0);
+		memtest_write(mt, i, one);
+	}
+
+	for (i = 0; i < mt->nwords; i++) {
+		memtest_check(mt, "march", i, one);
+		memtest_write(mt, i, 0);
+	}
+
+	for (i = mt->nwords; i-- > 0; ) {
+		memtest_check(mt, "march", i, 0);
+		memtest_write(mt, i, one);
+	}
+
+	for (i = mt->nwords; i-- > 0; ) {
+		memtest_check(mt, "march", i, one);
+		memtest_write(mt, i, 0);
+	}
+
+	for (i = 0; i < mt->nwords; i++)
+		memtest_check(mt, "march", i, 0);
+}
+
+static inline uint64_t xorshift64(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return *state = x;
+}
+
+static void memtest_random(struct memtest *mt)
+{
+	uint64_t mask = memtest_mask(mt->width);
+	uint64_t seed = 0x9e3779b97f4a7c15ULL * (mt->start + mt->pass + 1);
+	uint64_t state;
+	size_t i;
+
+	state = seed;
+	for (i = 0; i < mt->nwords; i++)
+		memtest_write(mt, i, xorshift64(&state) & mask);
+
+	state = seed;
+	for (i = 0; i < mt->nwords; i++)
+		memtest_check(mt, "random", i, xorshift64(&state) & mask);
+}
+
+static void *memtest_thread(void *arg)
+{
+	struct memtest *mt = arg;
+
+	if (mt->tests & MEMTEST_MARCH)
+		memtest_march(mt);
+
+	if (mt->tests & MEMTEST_RANDOM)
+		memtest_random(mt);
+
+	return NULL;
+}
+
+static int memtest_parse_tests(char *str)
+{
+	static const char * const names[] = { "data", "addr", "march", "random" };
+	int tests = 0, i;
+	char *name;
+
+	for (name = strtok(str, ","); name; name = strtok(NULL, ",")) {
+		for (i = 0; i < ARRAY_SIZE(names); i++)
+			if (!strcmp(name, names[i]))
+				break;
+
+		if (i == ARRAY_SIZE(names)) {
+			fprintf(stderr, "unknown test: %s\n", name);
+			return -1;
+		}
+
+		tests |= 1 << i;
+	}
+
+	return tests;
+}
+
+static int cmd_memtest(int argc, char **argv)
+{
+	struct memtest whole = { 0, }, *workers;
+	size_t size = 0, chunk, mapsize;
+	off_t start = 0x0;
+	char *file = "/dev/mem";
+	unsigned long errors = 0;
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int pass, passes = 1;
+	int width = 4;
+	int tests = MEMTEST_DATA | MEMTEST_ADDR | MEMTEST_MARCH | MEMTEST_RANDOM;
+	int opt, i;
+	int ret = -1;
+
+	while ((opt = getopt(argc, argv, "bwlqd:j:p:t:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			width = 1;
+			break;
+		case 'w':
+			width = 2;
+			break;
+		case 'l':
+			width = 4;
+			break;
+		case 'q':
+			width = 8;
+			break;
+		case 'd':
+			file = optarg;
+			break;
+		case 'j':
+			nthreads = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			tests = memtest_parse_tests(optarg);
+			if (tests < 0)
+				return EXIT_FAILURE;
+			break;
+		case 'h':
+			usage_memtest();
+			return 0;
+		}
+	}
+
+	if (optind + 1 != argc ||
+	    parse_area_spec(argv[optind], &start, &size) || size == ~0) {
+		fprintf(stderr, "memtest needs a region with a size\n");
+		return EXIT_FAILURE;
+	}
+
+	size &= ~(width - 1);
+	if (!size)
+		return EXIT_SUCCESS;
+
+	/* split into page aligned subranges, but don't use empty ones */
+	if (nthreads < 1)
+		nthreads = 1;
+	chunk = (size / nthreads) & ~(4096 - 1);
+	if (chunk < 4096) {
+		chunk = size < 4096 ? size : 4096;
+		nthreads = (size + chunk - 1) / chunk;
+	}
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers) {
+		fprintf(stderr, "could not allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	whole.handle = memtool_open(file, O_RDWR | O_CREAT);
+	if (!whole.handle) {
+		free(workers);
+		return EXIT_FAILURE;
+	}
+
+	whole.start = start;
+	whole.nwords = size / width;
+	whole.width = width;
+
+	for (pass = 0; pass < passes; pass++) {
+		if (tests & (MEMTEST_DATA | MEMTEST_ADDR)) {
+			whole.map = memtool_map(whole.handle, start, size,
+						PROT_READ | PROT_WRITE);
+			if (!whole.map) {
+				if (errno == EOPNOTSUPP)
+					fprintf(stderr, "access method doesn't support mapping\n");
+				goto out;
+			}
+
+			if (tests & MEMTEST_DATA)
+				memtest_data(&whole);
+			if (tests & MEMTEST_ADDR)
+				memtest_addr(&whole);
+
+			memtool_unmap(whole.handle, (void *)whole.map, size);
+		}
+
+		if (!(tests & (MEMTEST_MARCH | MEMTEST_RANDOM)))
+			continue;
+
+		for (i = 0; i < nthreads; i++) {
+			struct memtest *mt = &workers[i];
+
+			mt->start = start + i * chunk;
+			mapsize = i == nthreads - 1 ? size - i * chunk : chunk;
+			mt->nwords = mapsize / width;
+			mt->width = width;
+			mt->tests = tests;
+			mt->pass = pass;
+			mt->map = memtool_map(whole.handle, mt->start, mapsize,
+					      PROT_READ | PROT_WRITE);
+			if (!mt->map)
+				goto out_join;
+
+			if (pthread_create(&mt->thread, NULL, memtest_thread, mt)) {
+				fprintf(stderr, "could not create thread\n");
+				memtool_unmap(whole.handle, (void *)mt->map,
+					      mapsize);
+				mt->map = NULL;
+				goto out_join;
+			}
+		}
+
+out_join:
+		for (i = 0; i < nthreads && workers[i].map; i++) {
+			struct memtest *mt = &workers[i];
+
+			pthread_join(mt->thread, NULL);
+			memtool_unmap(whole.handle, (void *)mt->map,
+				      mt->nwords * width);
+			mt->map = NULL;
+		}
+
+		if (i < nthreads)
+			goto out;
+	}
+
+	ret = 0;
+out:
+	errors = whole.errors;
+	for (i = 0; i < nthreads; i++)
+		errors += workers[i].errors;
+
+	memtool_close(whole.handle);
+	free(workers);
+
+	if (!ret)
+		printf("%lu errors\n", errors);
+
+	return ret || errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage_monitor(void)
+{
+	printf(
+"monitor - report changes in a memory region\n"
+"\n"
+"Usage: monitor [-bwlq] [-s <FILE>] [-i <USEC>] [-n <PASSES>] [--format=FORMAT] REGION\n"
+"\n"
+"Repeatedly read REGION and report each value that changed since the\n"
+"previous pass with a timestamp, the offset and the old and new value.\n"
+"Runs until interrupted unless a number of passes is given.\n"
+"\n"
+"Options:\n"
+"  -b          byte access\n"
+"  -w          word access (16 bit)\n"
+"  -l          long access (32 bit)\n"
+"  -q          quad access (64 bit)\n"
+"  -s <FILE>   file to monitor (default /dev/mem)\n"
+"  -i <USEC>   start a pass every USEC microseconds (default 0: continuously)\n"
+"  -n <PASSES> stop after PASSES passes\n"
+"  --format=<hexdump|jsonl|csv|bin>\n"
+"              output format (default hexdump), see memtool(1)\n"
+	);
+}
+
+static volatile sig_atomic_t monitor_stop;
+
+static void monitor_sigint(int sig)
+{
+	monitor_stop = 1;
+}
+
+/*
+ * Report all values that differ between old and new. Only blocks with
+ * changes are looked at value by value.
+ */
+static void monitor_compare(struct outbuf *out, int format, uint64_t time,
+			    off_t start, const void *old, const void *new,
+			    size_t size, int width)
+{
+	size_t pos, len, i;
+
+	for (pos = 0; pos < size; pos += MEM_BLOCK) {
+		len = size - pos;
+		if (len >= MEM_BLOCK) {
+			len = MEM_BLOCK;
+			if (!mem_block_diff(old + pos, new + pos))
+				continue;
+		}
+
+		for (i = pos; i < pos + len; i += width) {
+			uint64_t a = mem_read(old + i, width);
+			uint64_t b = mem_read(new + i, width);
+
+			if (a != b)
+				out_change(out, format, time, start + i, a, b,
+					   width);
+		}
+	}
+}
+
+static int cmd_monitor(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "format", required_argument, NULL, 'F' },
+		{ }
+	};
+	static struct outbuf out;
+	struct sigaction sa = { .sa_handler = monitor_sigint };
+	struct timespec ts, next;
+	unsigned long interval = 0, pass, passes = 0;
+	size_t size = 0x100;
+	off_t start = 0x0;
+	char *file = "/dev/mem";
+	void *handle, *map, *old, *new, *tmp;
+	int format = OUT_HEXDUMP;
+	int width = 4;
+	int opt;
+	int ret = 0;
+
+	while ((opt = getopt_long(argc, argv, "bwlqs:i:n:h", long_options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'b':
+			width = 1;
+			break;
+		case 'w':
+			width = 2;
+			break;
+		case 'l':
+			width = 4;
+			break;
+		case 'q':
+			width = 8;
+			break;
+		case 's':
+			file = optarg;
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			format = out_parse_format(optarg);
+			if (format < 0)
+				return EXIT_FAILURE;
+			break;
+		case 'h':
+			usage_monitor();
+			return 0;
+		}
+	}
+
+	if (optind < argc) {
+		if (parse_area_spec(argv[optind], &start, &size)) {
+			fprintf(stderr, "could not parse: %s\n", argv[optind]);
+			return EXIT_FAILURE;
+		}
+		if (size == ~0)
+			size = 0x100;
+	}
+
+	size &= ~(width - 1);
+	if (!size)
+		return EXIT_SUCCESS;
+
+	old = malloc(size);
+	new = malloc(size);
+	if (!old || !new) {
+		fprintf(stderr, "could not allocate memory\n");
+		free(old);
+		free(new);
+		return EXIT_FAILURE;
+	}
+
+	handle = memtool_open(file, O_RDONLY);
+	if (!handle)
+		goto out_free;
+
+	map = memtool_map(handle, start, size, PROT_READ);
+	if (!map) {
+		if (errno == EOPNOTSUPP)
+			fprintf(stderr, "access method doesn't support mapping\n");
+		ret = -1;
+		goto out_close;
+	}
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	out_init(&out, STDOUT_FILENO);
+	out_change_header(&out, format);
+
+	mem_copy_from(old, map, size, width);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for (pass = 1; !monitor_stop && (!passes || pass < passes); pass++) {
+		if (interval) {
+			next.tv_sec += interval / 1000000;
+			next.tv_nsec += interval % 1000000 * 1000;
+			if (next.tv_nsec >= 1000000000) {
+				next.tv_sec++;
+				next.tv_nsec -= 1000000000;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&next, NULL);
+		}
+
+		mem_copy_from(new, map, size, width);
+		clock_gettime(CLOCK_REALTIME, &ts);
+
+		monitor_compare(&out, format,
+				(uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+				start, old, new, size, width);
+
+		/* keep the log current, but only write when there is output */
+		if (out.pos && out_flush(&out)) {
+			ret = -1;
+			break;
+		}
+
+		tmp = old;
+		old = new;
+		new = tmp;
+	}
+
+	memtool_unmap(handle, map, size);
+out_close:
+	memtool_close(handle);
+out_free:
+	free(old);
+	free(new);
+
+	return ret || !handle ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage_pagemap(void)
+{
+	printf(
+"pagemap - classify the pages of a memory region\n"
+"\n"
+"Usage: pagemap [-s <FILE>] [-j <THREADS>] [-P <PAGESIZE>] [-e <BITS>] REGION\n"
+"\n"
+"Classify each page of REGION as\n"
+"  zero    all bytes are zero (or a hole in a sparse file)\n"
+"  repeat  a single repeated 64 bit pattern\n"
+"  low     byte entropy below BITS bits per byte\n"
+"  high    byte entropy of at least BITS bits per byte\n"
+"and show runs of pages with the same class and the totals.\n"
+"\n"
+"Options:\n"
+"  -s <FILE>     file to classify (default /dev/mem)\n"
+"  -j <THREADS>  number of threads (default: number of online cpus)\n"
+"  -P <PAGESIZE> page size (default 4096)\n"
+"  -e <BITS>     entropy threshold for high entropy pages (default 7)\n"
+	);
+}
+
+enum page_class {
+	PAGE_ZERO,
+	PAGE_REPEAT,
+	PAGE_LOW,
+	PAGE_HIGH,
+	PAGE_CLASSES,
+};
+
+static const char * const page_class_names[] = {
+	[PAGE_ZERO] = "zero",
+	[PAGE_REPEAT] = "repeat",
+	[PAGE_LOW] = "low",
+	[PAGE_HIGH] = "high",
+};
+
+struct pagemap {
+	void *handle;
+	off_t start;
+	size_t size;
+	size_t pagesize;
+	uint8_t *classes;
+	/* c * log2(c) for c = 0..pagesize */
+	const double *clog;
+	double threshold;
+	pthread_t thread;
+	int running;
+	int ret;
+};
+
+static int page_classify(const struct pagemap *pm, const void *page,
+			 size_t len)
+{
+	unsigned int hist[4][256] = { { 0, }, };
+	const uint64_t *p = page;
+	const uint8_t *b = page;
+	uint64_t diff = 0;
+	double sum = 0;
+	size_t i;
+	int c;
+
+	if (is_zero(page, len))
+		return PAGE_ZERO;
+
+	if (!(len & 7)) {
+		for (i = 1; i < len / 8; i++)
+			diff |= p[i] ^ p[0];
+		if (!diff)
+			return PAGE_REPEAT;
+	}
+
+	/* separate histograms avoid stalls on repeated bytes */
+	for (i = 0; i + 4 <= len; i += 4) {
+		hist[0][b[i]]++;
+		hist[1][b[i + 1]]++;
+		hist[2][b[i + 2]]++;
+		hist[3][b[i + 3]]++;
+	}
+	for (; i < len; i++)
+		hist[0][b[i]]++;
+
+	for (c = 0; c < 256; c++)
+		sum += pm->clog[hist[0][c] + hist[1][c] + hist[2][c] + hist[3][c]];
+
+	/* H = log2(n) - sum(c * log2(c)) / n */
+	if (log2(len) - sum / len < pm->threshold)
+		return PAGE_LOW;
+
+	return PAGE_HIGH;
+}
+
+/* upper limit for the part of the region a thread has mapped at once */
+#define PAGEMAP_WINDOW	(64 * 1024 * 1024)
+
+static void *pagemap_thread(void *arg)
+{
+	struct pagemap *pm = arg;
+	size_t pagesize = pm->pagesize;
+	size_t window = PAGEMAP_WINDOW - PAGEMAP_WINDOW % pagesize;
+	size_t pos = 0, len, cnt, i;
+	void *map;
+
+	if (!window)
+		window = pagesize;
+
+	while (pos < pm->size) {
+		len = pm->size - pos;
+
+		/* don't touch holes of sparse files at all */
+		cnt = memtool_hole_size(pm->handle, pm->start + pos, len);
+		if (cnt >= (len < pagesize ? len : pagesize)) {
+			if (cnt == len)
+				cnt = (len + pagesize - 1) / pagesize;
+			else
+				cnt /= pagesize;
+			memset(pm->classes + pos / pagesize, PAGE_ZERO, cnt);
+			pos += cnt * pagesize;
+			continue;
+		}
+
+		/* map up to the page containing the next hole, bounded */
+		cnt = memtool_data_size(pm->handle, pm->start + pos, len);
+		cnt = cnt ? (cnt + pagesize - 1) / pagesize * pagesize : pagesize;
+		if (cnt > window)
+			cnt = window;
+		if (cnt > len)
+			cnt = len;
+
+		map = memtool_map(pm->handle, pm->start + pos, cnt, PROT_READ);
+		if (!map) {
+			if (errno == EOPNOTSUPP)
+				fprintf(stderr, "access method doesn't support mapping\n");
+			pm->ret = -1;
+			return NULL;
+		}
+
+		for (i = 0; i < cnt; i += pagesize)
+			pm->classes[(pos + i) / pagesize] =
+				page_classify(pm, map + i, cnt - i < pagesize ?
+					      cnt - i : pagesize);
+
+		memtool_unmap(pm->handle, map, cnt);
+		pos += cnt;
+	}
+
+	return NULL;
+}
+
+static int cmd_pagemap(int argc, char **argv)
+{
+	struct pagemap *workers;
+	size_t totals[PAGE_CLASSES] = { 0, };
+	size_t size = 0, pagesize = 4096, npages, chunk, i, run;
+	off_t start = 0x0;
+	char *file = "/dev/mem";
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	double threshold = 7.0;
+	uint8_t *classes;
+	double *clog;
+	void *handle;
+	long t;
+	int opt;
+	int ret = 0;
+
+	while ((opt = getopt(argc, argv, "s:j:P:e:h")) != -1) {
+		switch (opt) {
+		case 's':
+			file = optarg;
+			break;
+		case 'j':
+			nthreads = strtol(optarg, NULL, 0);
+			break;
+		case 'P':
+			pagesize = strtoull_suffix(optarg, NULL, 0);
+			break;
+		case 'e':
+			threshold = strtod(optarg, NULL);
+			break;
+		case 'h':
+			usage_pagemap();
+			return 0;
+		}
+	}
+
+	if (optind + 1 != argc ||
+	    parse_area_spec(argv[optind], &start, &size) || size == ~0) {
+		fprintf(stderr, "pagemap needs a region with a size\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!pagesize || pagesize & 7 || start & 7) {
+		fprintf(stderr, "page size and start must be multiples of 8\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!size)
+		return EXIT_SUCCESS;
+
+	npages = (size + pagesize - 1) / pagesize;
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > npages)
+		nthreads = npages;
+	chunk = (npages + nthreads - 1) / nthreads;
+	nthreads = (npages + chunk - 1) / chunk;
+
+	classes = malloc(npages);
+	clog = malloc((pagesize + 1) * sizeof(*clog));
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!classes || !clog || !workers) {
+		fprintf(stderr, "could not allocate memory\n");
+		ret = -1;
+		goto out_free;
+	}
+
+	clog[0] = 0;
+	for (i = 1; i <= pagesize; i++)
+		clog[i] = i * log2(i);
+
+	handle = memtool_open(file, O_RDONLY);
+	if (!handle) {
+		ret = -1;
+		goto out_free;
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		struct pagemap *pm = &workers[t];
+
+		pm->handle = handle;
+		pm->start = start + t * chunk * pagesize;
+		pm->size = t == nthreads - 1 ?
+			size - t * chunk * pagesize : chunk * pagesize;
+		pm->pagesize = pagesize;
+		pm->classes = classes + t * chunk;
+		pm->clog = clog;
+		pm->threshold = threshold;
+
+		if (pthread_create(&pm->thread, NULL, pagemap_thread, pm))
+			pagemap_thread(pm);
+		else
+			pm->running = 1;
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		if (workers[t].running)
+			pthread_join(workers[t].thread, NULL);
+		if (workers[t].ret < 0)
+			ret = -1;
+	}
+
+	memtool_close(handle);
+
+	if (ret)
+		goto out_free;
+
+	for (i = 0; i < npages; i += run) {
+		off_t first = start + i * pagesize, last;
+
+		for (run = 1; i + run < npages && classes[i + run] == classes[i]; run++)
+			;
+
+		last = i + run == npages ? start + size : first + run * pagesize;
+		printf("%08llx-%08llx %s\n", (unsigned long long)first,
+		       (unsigned long long)last - 1,
+		       page_class_names[classes[i]]);
+
+		totals[classes[i]] += run;
+	}
+
+	printf("\n");
+	for (i = 0; i < PAGE_CLASSES; i++)
+		printf("%-6s %10zu pages\n", page_class_names[i], totals[i]);
+
+out_free:
+	free(workers);
+	free(clog);
+	free(classes);
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage_membench(void)
+{
+	printf(
+"membench - measure memory bandwidth and latency\n"
+"\n"
+"Usage: membench [-s <FILE>] [-n <ITER>] [-uW] REGION\n"
+"\n"
+"Measure sequential and strided read throughput for all access widths\n"
+"in REGION. With -W also measure sequential and strided write throughput\n"
+"and the latency of dependent reads (pointer chasing), this destroys the\n"
+"content of REGION.\n"
+"The start of REGION must be a multiple of 8.\n"
+"\n"
+"Options:\n"
+"  -s <FILE> file to access (default /dev/mem)\n"
+"  -n <ITER> run each test ITER times and report the best (default 3)\n"
+"  -u        open FILE with O_SYNC, for /dev/mem this gives an uncached\n"
+"            mapping on most architectures\n"
+"  -W        also run tests that write to REGION\n"
+	);
+}
+
+#define MEMBENCH_CHASE_STRIDE	64
+
+static uint64_t membench_read(const volatile void *map, size_t size,
+			      size_t stride, int width)
+{
+	uint64_t sum = 0;
+	size_t pos;
+
+	for (pos = 0; pos + width <= size; pos += stride)
+		sum += mem_read(map + pos, width);
+
+	return sum;
+}
+
+static void membench_write(volatile void *map, size_t size, size_t stride,
+			   int width)
+{
+	size_t pos;
+
+	for (pos = 0; pos + width <= size; pos += stride)
+		mem_write(map + pos, pos, width);
+}
+
+/*
+ * Link all MEMBENCH_CHASE_STRIDE sized nodes in map to a single cycle in
+ * random order. Each node holds the offset of the next one.
+ */
+static int membench_chase_init(volatile void *map, size_t nodes)
+{
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	size_t *order, i, j, tmp;
+
+	order = malloc(nodes * sizeof(*order));
+	if (!order) {
+		fprintf(stderr, "could not allocate memory\n");
+		return -1;
+	}
+
+	for (i = 0; i < nodes; i++)
+		order[i] = i;
+
+	for (i = nodes - 1; i > 0; i--) {
+		j = xorshift64(&state) % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (i = 0; i < nodes; i++)
+		*(volatile uint64_t *)(map + order[i] * MEMBENCH_CHASE_STRIDE) =
+			order[(i + 1) % nodes] * MEMBENCH_CHASE_STRIDE;
+
+	free(order);
+
+	return 0;
+}
+
+static uint64_t membench_chase(const volatile void *map, size_t nodes)
+{
+	uint64_t off = 0;
+	size_t i;
+
+	for (i = 0; i < nodes; i++)
+		off = *(const volatile uint64_t *)(map + off);
+
+	return off;
+}
+
+static void membench_report(const char *name, uint64_t ns, size_t bytes,
+			    size_t accesses)
+{
+	printf("%-20s %10.3f %12.2f\n", name, (double)bytes / ns,
+	       (double)ns / accesses);
+}
+
+static int cmd_membench(int argc, char **argv)
+{
+	static const size_t strides[] = { 64, 4096 };
+	size_t size = 0, nodes, i;
+	off_t start = 0x0;
+	char *file = "/dev/mem";
+	unsigned long iter, iterations = 3;
+	uint64_t t, best;
+	volatile uint64_t sink;
+	int flags = O_RDONLY, prot = PROT_READ;
+	int write = 0;
+	void *handle, *map;
+	char name[48];
+	int opt, width;
+
+	while ((opt = getopt(argc, argv, "s:n:uWh")) != -1) {
+		switch (opt) {
+		case 's':
+			file = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			flags |= O_SYNC;
+			break;
+		case 'W':
+			write = 1;
+			break;
+		case 'h':
+			usage_membench();
+			return 0;
+		}
+	}
+
+	if (optind + 1 != argc ||
+	    parse_area_spec(argv[optind], &start, &size) || size == ~0) {
+		fprintf(stderr, "membench needs a region with a size\n");
+		return EXIT_FAILURE;
+	}
+
+	/* 64 bit accesses must be aligned, e.g. for device memory on ARM */
+	if (start & 7) {
+		fprintf(stderr, "start must be a multiple of 8\n");
+		return EXIT_FAILURE;
+	}
+
+	size &= ~7;
+	if (!size || !iterations)
+		return EXIT_SUCCESS;
+
+	if (write) {
+		flags = (flags & ~O_ACCMODE) | O_RDWR | O_CREAT;
+		prot |= PROT_WRITE;
+	}
+
+	handle = memtool_open(file, flags);
+	if (!handle)
+		return EXIT_FAILURE;
+
+	map = memtool_map(handle, start, size, prot);
+	if (!map) {
+		if (errno == EOPNOTSUPP)
+			fprintf(stderr, "access method doesn't support mapping\n");
+		memtool_close(handle);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-20s %10s %12s\n", "test", "GB/s", "ns/access");
+
+	for (width = 1; width <= 8; width <<= 1) {
+		for (best = ~0ULL, iter = 0; iter < iterations; iter++) {
+			t = lat_now();
+			sink = membench_read(map, size, width, width);
+			t = lat_now() - t;
+			if (t < best)
+				best = t;
+		}
+		snprintf(name, sizeof(name), "read %d", width);
+		membench_report(name, best, size, size / width);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(strides); i++) {
+		if (strides[i] >= size)
+			continue;
+
+		for (best = ~0ULL, iter = 0; iter < iterations; iter++) {
+			t = lat_now();
+			sink = membench_read(map, size, strides[i], 8);
+			t = lat_now() - t;
+			if (t < best)
+				best = t;
+		}
+		snprintf(name, sizeof(name), "read 8 stride %zu", strides[i]);
+		membench_report(name, best, 8 * (size / strides[i]),
+				size / strides[i]);
+	}
+
+	if (!write)
+		goto out;
+
+	for (width = 1; width <= 8; width <<= 1) {
+		for (best = ~0ULL, iter = 0; iter < iterations; iter++) {
+			t = lat_now();
+			membench_write(map, size, width, width);
+			t = lat_now() - t;
+			if (t < best)
+				best = t;
+		}
+		snprintf(name, sizeof(name), "write %d", width);
+		membench_report(name, best, size, size / width);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(strides); i++) {
+		if (strides[i] >= size)
+			continue;
+
+		for (best = ~0ULL, iter = 0; iter < iterations; iter++) {
+			t = lat_now();
+			membench_write(map, size, strides[i], 8);
+			t = lat_now() - t;
+			if (t < best)
+				best = t;
+		}
+		snprintf(name, sizeof(name), "write 8 stride %zu", strides[i]);
+		membench_report(name, best, 8 * (size / strides[i]),
+				size / strides[i]);
+	}
+
+	nodes = size / MEMBENCH_CHASE_STRIDE;
+	if (nodes > 1 && !membench_chase_init(map, nodes)) {
+		for (best = ~0ULL, iter = 0; iter < iterations; iter++) {
+			t = lat_now();
+			sink = membench_chase(map, nodes);
+			t = lat_now() - t;
+			if (t < best)
+				best = t;
+		}
+		membench_report("chase", best, 8 * nodes, nodes);
+	}
+
+out:
+	(void)sink;
+	memtool_unmap(handle, map, size);
+	memtool_close(handle);
+
+	return EXIT_SUCCESS;
+}
+
+static void usage_unpack(void)
+{
+	printf(
+"unpack - extract a compressed dump\n"
+"\n"
+"Usage: unpack [-o <FILE>] [-i] DUMP [REGION]\n"
+"\n"
+"Decompress DUMP written by 'md -z -o DUMP'. If REGION is given only\n"
+"that part is extracted, using the addresses of the original region.\n"
+"Only the chunks covering REGION are read and decompressed.\n"
+"\n"
+"Options:\n"
+"  -o <FILE> write the data to FILE instead of stdout\n"
+"  -i        show the region, chunk count and size of DUMP instead\n"
+"\n"
+"Zero filled blocks are not written to a regular FILE, so it becomes\n"
+"sparse.\n"
+	);
+}
+
+static int cmd_unpack(int argc, char **argv)
+{
+	struct zdump_info info;
+	struct zdump *zdump;
+	char *outfile = NULL;
+	int fd, outfd = STDOUT_FILENO, sparse = 0;
+	int show_info = 0;
+	off_t start;
+	size_t size, len;
+	char *buf;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "o:ih")) != -1) {
+		switch (opt) {
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'i':
+			show_info = 1;
+			break;
+		case 'h':
+			usage_unpack();
+			return 0;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		usage_unpack();
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		return EXIT_FAILURE;
+	}
+
+	zdump = zdump_open(fd, &info);
+	if (!zdump) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	if (show_info) {
+		printf("region: 0x%08" PRIx64 "+0x%" PRIx64 "\n",
+		       info.start, info.size);
+		printf("chunks: %" PRIu32 " of %" PRIu32 " bytes\n",
+		       info.nchunks, info.chunk_size);
+		printf("size:   %" PRIu64 " bytes (%.1f%%)\n", info.file_size,
+		       info.size ? 100.0 * info.file_size / info.size : 0.0);
+		goto out;
+	}
+
+	start = info.start;
+	size = info.size;
+	if (optind + 1 < argc) {
+		if (parse_area_spec(argv[optind + 1], &start, &size)) {
+			fprintf(stderr, "could not parse: %s\n",
+				argv[optind + 1]);
+			ret = -1;
+			goto out;
+		}
+		/* a start without size extracts up to the end */
+		if (size == ~0 && start >= info.start)
+			size = info.start + info.size - start;
+	}
+
+	buf = malloc(RAW_CHUNK);
+	if (!buf) {
+		fprintf(stderr, "could not allocate memory\n");
+		ret = -1;
+		goto out;
+	}
+
+	if (outfile) {
+		struct stat s;
+
+		outfd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (outfd < 0) {
+			perror("open");
+			free(buf);
+			ret = -1;
+			goto out;
+		}
+
+		sparse = !fstat(outfd, &s) && S_ISREG(s.st_mode);
+	}
+
+	while (size) {
+		len = size > RAW_CHUNK ? RAW_CHUNK : size;
+
+		ret = zdump_read(zdump, start, buf, len);
+		if (!ret)
+			ret = raw_write(outfd, buf, len, sparse);
+		if (ret)
+			break;
+
+		start += len;
+		size -= len;
+	}
+
+	if (outfile) {
+		/* the output might end with a hole, set the final size */
+		if (!ret && sparse &&
+		    ftruncate(outfd, lseek(outfd, 0, SEEK_CUR))) {
+			perror("ftruncate");
+			ret = -1;
+		}
+		if (close(outfd)) {
+			perror("close");
+			ret = -1;
+		}
+	}
+
+	free(buf);
+out:
+	zdump_close(zdump);
+	close(fd);
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+struct cmd {
+	int (*cmd)(int argc, char **argv);
+	const char *name;
+};
+
+static struct cmd cmds[] = {
 	{
 		.cmd = cmd_memory_display,
 		.name = "md",
 	}, {
 		.cmd = cmd_memory_write,
 		.name = "mw",
+	}, {
+		.cmd = cmd_load,
+		.name = "load",
+	}, {
+		.cmd = cmd_replay,
+		.name = "replay",
+	}, {
+		.cmd = cmd_lat,
+		.name = "lat",
+	}, {
+		.cmd = cmd_memtest,
+		.name = "memtest",
+	}, {
+		.cmd = cmd_monitor,
+		.name = "monitor",
+	}, {
+		.cmd = cmd_pagemap,
+		.name = "pagemap",
+	}, {
+		.cmd = cmd_membench,
+		.name = "membench",
+	}, {
+		.cmd = cmd_unpack,
+		.name = "unpack",
+#ifdef USE_MDIO
+	}, {
+		.cmd = cmd_mdio_scan,
+		.name = "mdio-scan",
+#endif
 	},
 };
 
+#ifdef USE_MDIO
+#define USAGE_MDIO_SCAN "mdio-scan: scan MDIO busses for phys\n"
+#else
+#define USAGE_MDIO_SCAN ""
+#endif
+
 static void usage(void)
 {
 	printf(
@@ -459,9 +3148,21 @@ static void usage(void)
 "memtool is divided into subcommands. Supported commands are:\n"
 "md: memory display, Show regions of memory\n"
 "mw: memory write, write values to memory\n"
+"load: load a file into memory\n"
+"replay: replay an access log\n"
+"lat: measure access latency\n"
+"memtest: test memory\n"
+"monitor: report changes in a memory region\n"
+"pagemap: classify the pages of a memory region\n"
+"membench: measure memory bandwidth and latency\n"
+"unpack: extract a compressed dump written by md -z\n"
+USAGE_MDIO_SCAN
 "\n"
 "To show help for a subcommand do 'memtool <cmd> -h'\n"
 "\n"
+"If MEMTOOL_RECORD is set in the environment, all accesses are appended\n"
+"to the access log named by it. Use replay to repeat them.\n"
+"\n"
 "memtool is a collection of tools to show (hexdump) and modify arbitrary files.\n"
 "By default /dev/mem is used to allow access to physical memory.\n"
 	);
@@ -469,8 +3170,9 @@ static void usage(void)
 
 int main(int argc, char **argv)
 {
-	int i;
+	int i, ret;
 	struct cmd *cmd;
+	char *logfile;
 
 	if (!strcmp(basename(argv[0]), "memtool")) {
 		argv++;
@@ -490,8 +3192,19 @@ int main(int argc, char **argv)
 
 	for (i = 0; i < ARRAY_SIZE(cmds); i++) {
 		cmd = &cmds[i];
-		if (!strcmp(argv[0], cmd->name))
-			return cmd->cmd(argc, argv);
+		if (strcmp(argv[0], cmd->name))
+			continue;
+
+		logfile = getenv("MEMTOOL_RECORD");
+		if (logfile && *logfile && memtool_record_start(logfile))
+			return EXIT_FAILURE;
+
+		ret = cmd->cmd(argc, argv);
+
+		if (memtool_record_stop())
+			ret = EXIT_FAILURE;
+
+		return ret;
 	}
 
 	fprintf(stderr, "No such command: %s\n", argv[0]);
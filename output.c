@@ -0,0 +1,291 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+void out_init(struct outbuf *out, int fd)
+{
+	out->fd = fd;
+	out->err = 0;
+	out->pos = 0;
+}
+
+/*
+ * Write out the buffered data. Returns -1 if this or any earlier write
+ * failed.
+ */
+int out_flush(struct outbuf *out)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (!out->err && done < out->pos) {
+		ret = write(out->fd, out->buf + done, out->pos - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			out->err = 1;
+			break;
+		}
+		done += ret;
+	}
+
+	out->pos = 0;
+
+	return out->err ? -1 : 0;
+}
+
+void out_write(struct outbuf *out, const void *data, size_t len)
+{
+	size_t n;
+
+	while (len) {
+		if (out->pos == sizeof(out->buf))
+			out_flush(out);
+
+		n = sizeof(out->buf) - out->pos;
+		if (n > len)
+			n = len;
+
+		memcpy(out->buf + out->pos, data, n);
+		out->pos += n;
+		data += n;
+		len -= n;
+	}
+}
+
+void out_str(struct outbuf *out, const char *str)
+{
+	out_write(out, str, strlen(str));
+}
+
+/* write val as exactly digits lower case hex digits */
+void out_hex(struct outbuf *out, uint64_t val, int digits)
+{
+	static const char hex[] = "0123456789abcdef";
+	char tmp[16];
+	int i;
+
+	for (i = digits - 1; i >= 0; i--) {
+		tmp[i] = hex[val & 0xf];
+		val >>= 4;
+	}
+
+	out_write(out, tmp, digits);
+}
+
+void out_dec(struct outbuf *out, uint64_t val)
+{
+	char tmp[20];
+	int i = sizeof(tmp);
+
+	do {
+		tmp[--i] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	out_write(out, tmp + i, sizeof(tmp) - i);
+}
+
+static void put_le64(unsigned char *p, uint64_t val)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		p[i] = val;
+		val >>= 8;
+	}
+}
+
+int out_parse_format(const char *name)
+{
+	if (!strcmp(name, "hexdump"))
+		return OUT_HEXDUMP;
+	if (!strcmp(name, "jsonl"))
+		return OUT_JSONL;
+	if (!strcmp(name, "csv"))
+		return OUT_CSV;
+	if (!strcmp(name, "bin"))
+		return OUT_BIN;
+
+	fprintf(stderr, "unknown format: %s\n", name);
+
+	return -1;
+}
+
+void out_header(struct outbuf *out, int format, int with_target)
+{
+	if (format != OUT_CSV)
+		return;
+
+	if (with_target)
+		out_str(out, "target,");
+	out_str(out, "offset,value\n");
+}
+
+static void out_json_str(struct outbuf *out, const char *str)
+{
+	out_str(out, "\"");
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			out_str(out, "\\");
+			out_write(out, str, 1);
+		} else if ((unsigned char)*str < 0x20) {
+			out_str(out, "\\u00");
+			out_hex(out, *str, 2);
+		} else {
+			out_write(out, str, 1);
+		}
+	}
+
+	out_str(out, "\"");
+}
+
+/* quote a csv field if necessary */
+static void out_csv_str(struct outbuf *out, const char *str)
+{
+	if (!strpbrk(str, ",\"\n")) {
+		out_str(out, str);
+		return;
+	}
+
+	out_str(out, "\"");
+	for (; *str; str++) {
+		if (*str == '"')
+			out_str(out, "\"");
+		out_write(out, str, 1);
+	}
+	out_str(out, "\"");
+}
+
+/*
+ * Encode a single value read at offset:
+ *
+ * jsonl: {"offset":4096,"value":305419896}
+ * csv:   0x00001000,0x12345678
+ * bin:   offset and value as 64 bit little endian numbers
+ *
+ * If target is not NULL it is added as first field to jsonl and csv.
+ */
+void out_record(struct outbuf *out, int format, const char *target,
+		uint64_t offset, uint64_t value, int width)
+{
+	unsigned char rec[OUT_BIN_RECSIZE];
+
+	switch (format) {
+	case OUT_JSONL:
+		out_str(out, "{");
+		if (target) {
+			out_str(out, "\"target\":");
+			out_json_str(out, target);
+			out_str(out, ",");
+		}
+		out_str(out, "\"offset\":");
+		out_dec(out, offset);
+		out_str(out, ",\"value\":");
+		out_dec(out, value);
+		out_str(out, "}\n");
+		break;
+	case OUT_CSV:
+		if (target) {
+			out_csv_str(out, target);
+			out_str(out, ",");
+		}
+		out_str(out, "0x");
+		out_hex(out, offset, offset >> 32 ? 16 : 8);
+		out_str(out, ",0x");
+		out_hex(out, value, 2 * width);
+		out_str(out, "\n");
+		break;
+	case OUT_BIN:
+		put_le64(rec, offset);
+		put_le64(rec + 8, value);
+		out_write(out, rec, sizeof(rec));
+		break;
+	}
+}
+
+void out_change_header(struct outbuf *out, int format)
+{
+	if (format == OUT_CSV)
+		out_str(out, "time,offset,old,new\n");
+}
+
+/*
+ * Encode a change of the value at offset, time is in ns since the epoch:
+ *
+ * hexdump: 1539939600.000000000 00001000: 12345678 -> 12345679
+ * jsonl:   {"time":1539939600000000000,"offset":4096,"old":305419896,"new":305419897}
+ * csv:     1539939600.000000000,0x00001000,0x12345678,0x12345679
+ * bin:     time, offset, old and new value as 64 bit little endian numbers
+ */
+void out_change(struct outbuf *out, int format, uint64_t time,
+		uint64_t offset, uint64_t old, uint64_t new, int width)
+{
+	static const char ns[] = "000000000";
+	unsigned char rec[OUT_BIN_CHANGESIZE];
+	char tmp[20];
+	int i;
+
+	switch (format) {
+	case OUT_JSONL:
+		out_str(out, "{\"time\":");
+		out_dec(out, time);
+		out_str(out, ",\"offset\":");
+		out_dec(out, offset);
+		out_str(out, ",\"old\":");
+		out_dec(out, old);
+		out_str(out, ",\"new\":");
+		out_dec(out, new);
+		out_str(out, "}\n");
+		return;
+	case OUT_BIN:
+		put_le64(rec, time);
+		put_le64(rec + 8, offset);
+		put_le64(rec + 16, old);
+		put_le64(rec + 24, new);
+		out_write(out, rec, sizeof(rec));
+		return;
+	}
+
+	out_dec(out, time / 1000000000);
+	out_str(out, ".");
+	/* zero padded nanoseconds */
+	for (i = 0, time %= 1000000000; time; i++, time /= 10)
+		tmp[i] = '0' + time % 10;
+	out_write(out, ns, 9 - i);
+	while (i--)
+		out_write(out, &tmp[i], 1);
+
+	if (format == OUT_CSV) {
+		out_str(out, ",0x");
+		out_hex(out, offset, offset >> 32 ? 16 : 8);
+		out_str(out, ",0x");
+		out_hex(out, old, 2 * width);
+		out_str(out, ",0x");
+		out_hex(out, new, 2 * width);
+	} else {
+		out_str(out, " ");
+		out_hex(out, offset, offset >> 32 ? 16 : 8);
+		out_str(out, ": ");
+		out_hex(out, old, 2 * width);
+		out_str(out, " -> ");
+		out_hex(out, new, 2 * width);
+	}
+	out_str(out, "\n");
+}
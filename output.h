@@ -0,0 +1,49 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define OUTBUF_SIZE	65536
+
+/* buffered writer for output that is produced without stdio */
+struct outbuf {
+	int fd;
+	int err;
+	size_t pos;
+	char buf[OUTBUF_SIZE];
+};
+
+enum out_format {
+	OUT_HEXDUMP,
+	OUT_JSONL,
+	OUT_CSV,
+	OUT_BIN,
+};
+
+/* size of a record of out_record() and out_change() in OUT_BIN format */
+#define OUT_BIN_RECSIZE		16
+#define OUT_BIN_CHANGESIZE	32
+
+void out_init(struct outbuf *out, int fd);
+int out_flush(struct outbuf *out);
+void out_write(struct outbuf *out, const void *data, size_t len);
+void out_str(struct outbuf *out, const char *str);
+void out_hex(struct outbuf *out, uint64_t val, int digits);
+void out_dec(struct outbuf *out, uint64_t val);
+
+int out_parse_format(const char *name);
+void out_header(struct outbuf *out, int format, int with_target);
+void out_record(struct outbuf *out, int format, const char *target,
+		uint64_t offset, uint64_t value, int width);
+void out_change_header(struct outbuf *out, int format);
+void out_change(struct outbuf *out, int format, uint64_t time,
+		uint64_t offset, uint64_t old, uint64_t new, int width);
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# version 2, as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# Run all membench tests, including the writing ones, on a file on tmpfs.
+# This exercises the mapping of a file and all access widths without
+# needing /dev/mem. The test is skipped if there is no /dev/shm.
+
+[ -d /dev/shm ] && [ -w /dev/shm ] || exit 77
+
+file=$(mktemp /dev/shm/memtool-test.XXXXXX) || exit 77
+out=$(mktemp) || exit 99
+trap 'rm -f "$file" "$out"' EXIT
+
+dd if=/dev/zero of="$file" bs=1024 count=1024 2> /dev/null || exit 99
+
+if ! ./memtool membench -W -n 1 -s "$file" 0x1000+0xff000 > "$out"; then
+	echo "membench failed"
+	exit 1
+fi
+
+cat "$out"
+
+for test in "read 1" "read 2" "read 4" "read 8" \
+	    "read 8 stride 64" "read 8 stride 4096" \
+	    "write 1" "write 2" "write 4" "write 8" \
+	    "write 8 stride 64" "write 8 stride 4096" "chase"; do
+	if ! grep -q "^$test  " "$out"; then
+		echo "missing result for \"$test\""
+		exit 1
+	fi
+done
@@ -0,0 +1,496 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lz4.h"
+#include "output.h"
+#include "zdump.h"
+
+struct zdump_entry {
+	uint64_t offset;
+	uint32_t len;
+	uint32_t flags;
+};
+
+/* a chunk being compressed by one of the threads */
+struct zdump_chunk {
+	const uint8_t *raw;
+	size_t rawlen;
+	uint8_t *buf;
+	size_t len;
+	uint32_t flags;
+	pthread_t thread;
+	int started;
+};
+
+struct zdump {
+	int fd;
+	uint64_t start;
+	uint64_t size;
+	size_t chunk_size;
+	struct zdump_entry *index;
+	uint32_t nchunks;
+
+	/* writing */
+	struct outbuf out;
+	uint64_t pos;
+	int threads;
+	uint8_t *raw;
+	size_t fill;
+	struct zdump_chunk *chunks;
+	size_t index_alloc;
+
+	/* reading */
+	uint8_t *cache;
+	long cached;
+	uint8_t *comp;
+};
+
+static void put_le32(uint8_t *p, uint32_t val)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = val >> (8 * i);
+}
+
+static void put_le64(uint8_t *p, uint64_t val)
+{
+	put_le32(p, val);
+	put_le32(p + 4, val >> 32);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+static void zdump_free(struct zdump *z)
+{
+	free(z->index);
+	free(z->raw);
+	free(z->chunks);
+	free(z->cache);
+	free(z->comp);
+	free(z);
+}
+
+/*
+ * Create a compressed dump of the memory starting at start and write it to
+ * fd. The data passed to zdump_write() is collected until each of threads
+ * threads can compress a chunk of chunk_size bytes in parallel.
+ */
+struct zdump *zdump_create(int fd, uint64_t start, size_t chunk_size,
+			   int threads)
+{
+	uint8_t header[ZDUMP_HEADER_SIZE] = { 0, };
+	struct zdump *z;
+	int i;
+
+	if (threads < 1)
+		threads = 1;
+
+	z = calloc(1, sizeof(*z));
+	if (!z)
+		goto nomem;
+
+	z->fd = fd;
+	z->start = start;
+	z->chunk_size = chunk_size;
+	z->threads = threads;
+	z->raw = malloc(threads * chunk_size);
+	z->chunks = calloc(threads, sizeof(*z->chunks));
+	if (!z->raw || !z->chunks)
+		goto nomem;
+
+	/* compressed data is only used if it is smaller than the chunk */
+	for (i = 0; i < threads; i++) {
+		z->chunks[i].buf = malloc(chunk_size);
+		if (!z->chunks[i].buf)
+			goto nomem;
+	}
+
+	out_init(&z->out, fd);
+
+	put_le32(header, ZDUMP_MAGIC);
+	put_le32(header + 4, ZDUMP_VERSION);
+	put_le32(header + 8, chunk_size);
+	out_write(&z->out, header, sizeof(header));
+	z->pos = sizeof(header);
+
+	return z;
+
+nomem:
+	fprintf(stderr, "could not allocate memory\n");
+	if (z) {
+		for (i = 0; z->chunks && i < threads; i++)
+			free(z->chunks[i].buf);
+		zdump_free(z);
+	}
+
+	return NULL;
+}
+
+static void *zdump_compress(void *arg)
+{
+	struct zdump_chunk *c = arg;
+
+	/* only use the compressed data if it is smaller */
+	c->len = lz4_compress(c->raw, c->rawlen, c->buf, c->rawlen - 1);
+	c->flags = 0;
+	if (!c->len) {
+		c->len = c->rawlen;
+		c->flags = ZDUMP_STORED;
+	}
+
+	return NULL;
+}
+
+/* compress the collected chunks in parallel and write them in order */
+static int zdump_flush(struct zdump *z)
+{
+	size_t n = (z->fill + z->chunk_size - 1) / z->chunk_size;
+	struct zdump_entry *e;
+	size_t i;
+
+	if (z->nchunks + n > z->index_alloc) {
+		size_t alloc = z->index_alloc ? z->index_alloc : 64;
+
+		while (alloc < z->nchunks + n)
+			alloc *= 2;
+
+		e = realloc(z->index, alloc * sizeof(*e));
+		if (!e) {
+			fprintf(stderr, "could not allocate memory\n");
+			return -1;
+		}
+		z->index = e;
+		z->index_alloc = alloc;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct zdump_chunk *c = &z->chunks[i];
+
+		c->raw = z->raw + i * z->chunk_size;
+		c->rawlen = z->fill - i * z->chunk_size;
+		if (c->rawlen > z->chunk_size)
+			c->rawlen = z->chunk_size;
+	}
+
+	/* the first chunk (and any that fail to start) is done by the caller */
+	for (i = 1; i < n; i++)
+		z->chunks[i].started = !pthread_create(&z->chunks[i].thread,
+						       NULL, zdump_compress,
+						       &z->chunks[i]);
+
+	for (i = 0; i < n; i++) {
+		struct zdump_chunk *c = &z->chunks[i];
+
+		if (c->started) {
+			pthread_join(c->thread, NULL);
+			c->started = 0;
+		} else {
+			zdump_compress(c);
+		}
+
+		e = &z->index[z->nchunks++];
+		e->offset = z->pos;
+		e->len = c->len;
+		e->flags = c->flags;
+
+		out_write(&z->out, c->flags & ZDUMP_STORED ? c->raw : c->buf,
+			  c->len);
+		z->pos += c->len;
+	}
+
+	z->size += z->fill;
+	z->fill = 0;
+
+	return z->out.err ? -1 : 0;
+}
+
+int zdump_write(struct zdump *z, const void *buf, size_t nbytes)
+{
+	size_t len, batch = z->threads * z->chunk_size;
+
+	while (nbytes) {
+		len = batch - z->fill;
+		if (len > nbytes)
+			len = nbytes;
+
+		memcpy(z->raw + z->fill, buf, len);
+		z->fill += len;
+		buf += len;
+		nbytes -= len;
+
+		if (z->fill == batch && zdump_flush(z))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Write the remaining data, the index and the trailer and free z. The
+ * file descriptor is not closed.
+ */
+int zdump_finish(struct zdump *z)
+{
+	uint8_t buf[ZDUMP_TRAILER_SIZE] = { 0, };
+	uint32_t i;
+	int ret;
+
+	ret = z->fill ? zdump_flush(z) : 0;
+
+	for (i = 0; !ret && i < z->nchunks; i++) {
+		put_le64(buf, z->index[i].offset);
+		put_le32(buf + 8, z->index[i].len);
+		put_le32(buf + 12, z->index[i].flags);
+		out_write(&z->out, buf, ZDUMP_ENTRY_SIZE);
+	}
+
+	put_le64(buf, z->start);
+	put_le64(buf + 8, z->size);
+	put_le64(buf + 16, z->pos);
+	put_le32(buf + 24, z->nchunks);
+	put_le32(buf + 28, ZDUMP_INDEX_MAGIC);
+	out_write(&z->out, buf, sizeof(buf));
+
+	if (out_flush(&z->out))
+		ret = -1;
+
+	for (i = 0; i < z->threads; i++)
+		free(z->chunks[i].buf);
+	zdump_free(z);
+
+	return ret;
+}
+
+static int pread_full(int fd, void *buf, size_t nbytes, off_t offset)
+{
+	ssize_t ret;
+
+	while (nbytes) {
+		ret = pread(fd, buf, nbytes, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			return -1;
+		}
+		if (!ret) {
+			fprintf(stderr, "compressed dump is truncated\n");
+			return -1;
+		}
+		buf += ret;
+		offset += ret;
+		nbytes -= ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Open the compressed dump in fd for reading. fd must be seekable because
+ * the index is at the end of the file.
+ */
+struct zdump *zdump_open(int fd, struct zdump_info *info)
+{
+	uint8_t buf[ZDUMP_TRAILER_SIZE];
+	uint64_t index_offset;
+	struct zdump *z;
+	uint8_t *index = NULL;
+	struct stat s;
+	uint32_t i;
+
+	if (fstat(fd, &s)) {
+		perror("fstat");
+		return NULL;
+	}
+
+	z = calloc(1, sizeof(*z));
+	if (!z) {
+		fprintf(stderr, "could not allocate memory\n");
+		return NULL;
+	}
+
+	z->fd = fd;
+	z->cached = -1;
+
+	if (s.st_size < ZDUMP_HEADER_SIZE + ZDUMP_TRAILER_SIZE)
+		goto corrupt;
+
+	if (pread_full(fd, buf, ZDUMP_HEADER_SIZE, 0))
+		goto err;
+
+	if (get_le32(buf) != ZDUMP_MAGIC) {
+		fprintf(stderr, "not a compressed dump\n");
+		goto err;
+	}
+
+	if (get_le32(buf + 4) != ZDUMP_VERSION) {
+		fprintf(stderr, "unsupported compressed dump version %u\n",
+			get_le32(buf + 4));
+		goto err;
+	}
+
+	z->chunk_size = get_le32(buf + 8);
+
+	if (pread_full(fd, buf, ZDUMP_TRAILER_SIZE,
+		       s.st_size - ZDUMP_TRAILER_SIZE))
+		goto err;
+
+	if (get_le32(buf + 28) != ZDUMP_INDEX_MAGIC)
+		goto corrupt;
+
+	z->start = get_le64(buf);
+	z->size = get_le64(buf + 8);
+	index_offset = get_le64(buf + 16);
+	z->nchunks = get_le32(buf + 24);
+
+	if (!z->chunk_size ||
+	    (z->size + z->chunk_size - 1) / z->chunk_size != z->nchunks ||
+	    index_offset + (uint64_t)z->nchunks * ZDUMP_ENTRY_SIZE +
+			ZDUMP_TRAILER_SIZE != s.st_size)
+		goto corrupt;
+
+	z->index = calloc(z->nchunks, sizeof(*z->index));
+	index = malloc((size_t)z->nchunks * ZDUMP_ENTRY_SIZE);
+	z->cache = malloc(z->chunk_size);
+	z->comp = malloc(z->chunk_size);
+	if ((z->nchunks && (!z->index || !index)) || !z->cache || !z->comp) {
+		fprintf(stderr, "could not allocate memory\n");
+		goto err;
+	}
+
+	if (pread_full(fd, index, (size_t)z->nchunks * ZDUMP_ENTRY_SIZE,
+		       index_offset))
+		goto err;
+
+	for (i = 0; i < z->nchunks; i++) {
+		struct zdump_entry *e = &z->index[i];
+		const uint8_t *p = index + i * ZDUMP_ENTRY_SIZE;
+
+		e->offset = get_le64(p);
+		e->len = get_le32(p + 8);
+		e->flags = get_le32(p + 12);
+
+		if (e->len > z->chunk_size || e->offset < ZDUMP_HEADER_SIZE ||
+		    e->offset + e->len > index_offset)
+			goto corrupt;
+	}
+
+	free(index);
+
+	info->start = z->start;
+	info->size = z->size;
+	info->chunk_size = z->chunk_size;
+	info->nchunks = z->nchunks;
+	info->file_size = s.st_size;
+
+	return z;
+
+corrupt:
+	fprintf(stderr, "compressed dump is corrupt\n");
+err:
+	free(index);
+	zdump_free(z);
+
+	return NULL;
+}
+
+static int zdump_load(struct zdump *z, uint32_t chunk)
+{
+	const struct zdump_entry *e = &z->index[chunk];
+	size_t rawlen = z->size - (uint64_t)chunk * z->chunk_size;
+
+	if (z->cached == chunk)
+		return 0;
+
+	if (rawlen > z->chunk_size)
+		rawlen = z->chunk_size;
+
+	z->cached = -1;
+
+	if (e->flags & ZDUMP_STORED) {
+		if (e->len != rawlen)
+			goto corrupt;
+		if (pread_full(z->fd, z->cache, rawlen, e->offset))
+			return -1;
+	} else {
+		if (pread_full(z->fd, z->comp, e->len, e->offset))
+			return -1;
+		if (lz4_decompress(z->comp, e->len, z->cache, rawlen) != rawlen)
+			goto corrupt;
+	}
+
+	z->cached = chunk;
+
+	return 0;
+
+corrupt:
+	fprintf(stderr, "compressed dump is corrupt (chunk %u)\n", chunk);
+
+	return -1;
+}
+
+/*
+ * Read nbytes of the dump at offset (an address of the dumped memory) into
+ * buf. Only the chunks covering the range are decompressed.
+ */
+int zdump_read(struct zdump *z, uint64_t offset, void *buf, size_t nbytes)
+{
+	uint64_t pos;
+	uint32_t chunk;
+	size_t len;
+
+	if (offset < z->start || offset - z->start > z->size ||
+	    nbytes > z->size - (offset - z->start)) {
+		fprintf(stderr, "range is not part of the compressed dump\n");
+		return -1;
+	}
+
+	pos = offset - z->start;
+
+	while (nbytes) {
+		chunk = pos / z->chunk_size;
+		if (zdump_load(z, chunk))
+			return -1;
+
+		len = z->chunk_size - pos % z->chunk_size;
+		if (len > nbytes)
+			len = nbytes;
+
+		memcpy(buf, z->cache + pos % z->chunk_size, len);
+		buf += len;
+		pos += len;
+		nbytes -= len;
+	}
+
+	return 0;
+}
+
+void zdump_close(struct zdump *z)
+{
+	zdump_free(z);
+}
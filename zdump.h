@@ -0,0 +1,54 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Compressed dump file format, all numbers are little endian:
+ *
+ * header:  magic "MTZ1", version (32 bit), chunk size (32 bit), 0 (32 bit)
+ * chunks:  each chunk_size bytes of the dump (the last one may be shorter)
+ *          compressed in LZ4 block format or stored if that doesn't help
+ * index:   per chunk its file offset (64 bit), compressed size (32 bit)
+ *          and flags (32 bit)
+ * trailer: start address and size of the dump (64 bit each), file offset
+ *          of the index (64 bit), number of chunks (32 bit), magic "MTZI"
+ *
+ * The header is written first and everything else sequentially, so a dump
+ * can be written to a pipe. Reading starts at the trailer and can
+ * decompress any part of the dump using the index.
+ */
+#define ZDUMP_MAGIC		0x315a544d	/* "MTZ1" */
+#define ZDUMP_INDEX_MAGIC	0x495a544d	/* "MTZI" */
+#define ZDUMP_VERSION		1
+#define ZDUMP_HEADER_SIZE	16
+#define ZDUMP_ENTRY_SIZE	16
+#define ZDUMP_TRAILER_SIZE	32
+
+#define ZDUMP_STORED		(1 << 0)
+
+struct zdump_info {
+	uint64_t start;
+	uint64_t size;
+	uint32_t chunk_size;
+	uint32_t nchunks;
+	uint64_t file_size;
+};
+
+struct zdump *zdump_create(int fd, uint64_t start, size_t chunk_size,
+			   int threads);
+int zdump_write(struct zdump *z, const void *buf, size_t nbytes);
+int zdump_finish(struct zdump *z);
+
+struct zdump *zdump_open(int fd, struct zdump_info *info);
+int zdump_read(struct zdump *z, uint64_t offset, void *buf, size_t nbytes);
+void zdump_close(struct zdump *z);